@@ -0,0 +1,42 @@
+#!/bin/sh
+# bench.sh: end-to-end workload benchmarks for the ed line editor.
+# Copyright (C) 2022 Mathias Fuchs
+# This file is free software; you have unlimited permission to copy,
+# distribute and modify it.
+#
+# Usage: bench/bench.sh [ed]
+# Generate a corpus of each kind and size with gencorpus, run each
+# workload on it through runbench, and write one CSV line per run to
+# stdout. Expects gencorpus and runbench next to this script ('make bench'
+# builds them).
+#
+# Environment:
+#   BENCH_KINDS      corpus kinds (default "cpp log giant binary crlf")
+#   BENCH_SIZES      corpus sizes (default "1M 16M"; e.g. "1M 64M 1G 10G")
+#   BENCH_WORKLOADS  workloads (default all, see workloads.sh)
+#   BENCH_DIR        where corpora and scripts go (default /tmp/ed-bench)
+
+ed=${1:-./ed}
+dir=$(dirname "$0")
+kinds=${BENCH_KINDS:-"cpp log giant binary crlf"}
+sizes=${BENCH_SIZES:-"1M 16M"}
+work=${BENCH_DIR:-/tmp/ed-bench}
+
+mkdir -p "$work" || exit 1
+
+. "$dir/workloads.sh"
+workloads=${BENCH_WORKLOADS:-$all_workloads}
+
+echo "kind,size,workload,exit_status,wall_s,user_s,sys_s,maxrss_kb"
+for size in $sizes ; do
+  for kind in $kinds ; do
+    corpus=$(corpus $kind $size) || exit 1
+    lines=$(wc -l < "$corpus")
+    for wl in $workloads ; do
+      script $wl $lines > "$work/script.ed" || exit 1
+      "$dir/runbench" "$kind,$size,$wl" "$work/script.ed" /dev/null \
+        "$ed" -s "$corpus"
+    done
+  done
+done
+rm -f "$work/out" "$work/script.ed"
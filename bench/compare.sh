@@ -0,0 +1,59 @@
+#!/bin/sh
+# compare.sh: run the benchmark workloads through two ed binaries and
+# compare their output, time and memory.
+# Copyright (C) 2022 Mathias Fuchs
+# This file is free software; you have unlimited permission to copy,
+# distribute and modify it.
+#
+# Usage: bench/compare.sh [ed [ed-plain]]
+# 'ed-plain' is this tree built with ED_NO_HIGHLIGHT ('make plain'), i.e.
+# plain GNU ed 1.18 plus the changes of this fork other than highlighting.
+# Any other pair of binaries works too ('make pgo' uses it).
+# For each corpus and workload write one CSV line with:
+#   same        1 if stdout and written files are byte-identical
+#   same_text   1 if they are identical after removing ANSI color escapes
+#   wall_*, rss_*  wall time in s and peak RSS in kB of binaries a and b
+#   wall_pct    how much slower (+) or faster (-) a is than b
+# A 0 in same_text means the two binaries edit differently.
+# Environment: the same as bench.sh.
+
+ed=${1:-./ed}
+plain=${2:-./ed-plain}
+dir=$(dirname "$0")
+kinds=${BENCH_KINDS:-"cpp log giant binary crlf"}
+sizes=${BENCH_SIZES:-"1M 16M"}
+work=${BENCH_DIR:-/tmp/ed-bench}
+
+mkdir -p "$work" || exit 1
+
+. "$dir/workloads.sh"
+workloads=${BENCH_WORKLOADS:-$all_workloads}
+
+# run ed binary $1 on corpus $2 with $work/script.ed; leave its output
+# (stdout, then any file written) in $3; print "wall,rss"
+run() {
+  rm -f "$work/out"
+  "$dir/runbench" x "$work/script.ed" "$3" "$1" -s "$2" | cut -d, -f3,6
+  [ -f "$work/out" ] && cat "$work/out" >> "$3"
+}
+
+echo "kind,size,workload,same,same_text,wall_a,wall_b,wall_pct,rss_a,rss_b"
+for size in $sizes ; do
+  for kind in $kinds ; do
+    corpus=$(corpus $kind $size) || exit 1
+    lines=$(wc -l < "$corpus")
+    for wl in $workloads ; do
+      script $wl $lines > "$work/script.ed" || exit 1
+      a=$(run "$ed" "$corpus" "$work/out.ed")
+      b=$(run "$plain" "$corpus" "$work/out.plain")
+      same=0 ; cmp -s "$work/out.ed" "$work/out.plain" && same=1
+      same_text=0
+      sed 's/\x1b\[[0-9;]*m//g' "$work/out.ed" | cmp -s - "$work/out.plain" &&
+        same_text=1
+      echo "$kind,$size,$wl,$same,$same_text,${a%,*},${b%,*},${a#*,},${b#*,}" |
+        awk -F, -v OFS=, '{ pct = ( $7 > 0 ) ? 100 * ( $6 - $7 ) / $7 : 0
+                           print $1,$2,$3,$4,$5,$6,$7,sprintf( "%.1f", pct ),$8,$9 }'
+    done
+  done
+done
+rm -f "$work/out" "$work/out.ed" "$work/out.plain" "$work/script.ed"
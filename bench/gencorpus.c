@@ -0,0 +1,176 @@
+/* gencorpus.c: deterministic test corpus generator for the ed benchmarks. */
+/* GNU ed - The GNU line editor.
+   Copyright (C) 2022 Mathias Fuchs
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+   Usage: gencorpus kind size [seed]
+   Write 'size' bytes (suffixes k, M, G allowed) of the given kind to
+   stdout, or 'size' lines if it ends in 'l' (for cpp, log and crlf only).
+   The same arguments always produce the same bytes.
+
+   kinds:  cpp     C++-like source with comments, strings and nesting
+           log     timestamped log lines, some of them containing "ERROR"
+           giant   a single line without newlines except the last byte
+           binary  random bytes including ASCII NULs
+           crlf    short text lines terminated by CR/LF
+   Usage: gencorpus addrs lines count [seed]
+   Write an ed script of 'count' commands printing random lines in
+   [1, lines].
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static unsigned long long rng_state = 88172645463325252ULL;
+static int by_lines = 0;		/* size is a number of lines */
+
+/* xorshift64; the corpus must not depend on the libc rand() */
+static unsigned long long rnd( void )
+  {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+  }
+
+static int rnd_below( const int n ) { return rnd() % n; }
+
+
+static long long parse_size( const char * const s )
+  {
+  char * tail;
+  long long n = strtoll( s, &tail, 10 );
+  switch( *tail )
+    {
+    case 'G': case 'g': n *= 1024; /* fall through */
+    case 'M': case 'm': n *= 1024; /* fall through */
+    case 'k': case 'K': n *= 1024; break;
+    case 'l': case 'L': by_lines = 1; break;
+    case 0: break;
+    default: return -1;
+    }
+  return n;
+  }
+
+
+static const char * const words[] =
+  { "buffer", "line", "node", "scratch", "undo", "regex", "print", "active",
+    "global", "search", "append", "delete", "yank", "mark", "file", "size" };
+static const char * word( void ) { return words[rnd_below( 16 )]; }
+
+
+/* write one line of a C++-like source file, keeping track of nesting */
+static int cpp_line( char * const buf )
+  {
+  static int depth = 0;
+  static int in_comment = 0;
+  int n = 0, i;
+
+  for( i = 0; i < depth && i < 8; ++i ) n += sprintf( buf + n, "  " );
+  if( in_comment )
+    {
+    if( rnd_below( 4 ) == 0 ) { in_comment = 0; return n + sprintf( buf + n, " */\n" ); }
+    return n + sprintf( buf + n, " * %s %s of the %s\n", word(), word(), word() );
+    }
+  switch( rnd_below( 12 ) )
+    {
+    case 0: if( depth > 0 )			/* close a block; unindent */
+              { --depth; n = 2 * ( ( depth < 8 ) ? depth : 8 );
+                return n + sprintf( buf + n, "}\n" ); }
+            /* fall through */
+    case 1: ++depth;
+            return n + sprintf( buf + n, "static int %s_%s( const %s_t * p )\n{\n",
+                                word(), word(), word() );
+    case 2: in_comment = 1; return n + sprintf( buf + n, "/* %s\n", word() );
+    case 3: return n + sprintf( buf + n, "// %s the %s\n", word(), word() );
+    case 4: return n + sprintf( buf + n, "printf( \"%s %%d {\\n\", %s );\n",
+                                word(), word() );
+    case 5: return n + sprintf( buf + n, "#define %s_MAX %d\n", word(), rnd_below( 1000 ) );
+    case 6: return n + sprintf( buf + n, "if( %s[%d] != '%c' ) return %s;\n",
+                                word(), rnd_below( 64 ), 'a' + rnd_below( 26 ), word() );
+    default: return n + sprintf( buf + n, "%s = %s( %s, %d );\n", word(), word(),
+                                 word(), rnd_below( 100000 ) );
+    }
+  }
+
+
+static int log_line( char * const buf )
+  {
+  static long long t = 1600000000LL * 1000;
+  static const char * const levels[] = { "INFO", "DEBUG", "WARN", "ERROR" };
+  t += rnd_below( 5000 );
+  return sprintf( buf, "%lld.%03d [%s] %s: %s %s %d\n", t / 1000, (int)( t % 1000 ),
+                  levels[ rnd_below( 10 ) == 0 ? 3 : rnd_below( 3 )],
+                  word(), word(), word(), rnd_below( 1 << 20 ) );
+  }
+
+
+static int crlf_line( char * const buf )
+  { return sprintf( buf, "%s %s %d\r\n", word(), word(), rnd_below( 1000 ) ); }
+
+
+int main( const int argc, const char * const argv[] )
+  {
+  char buf[4096];
+  long long size, done = 0;
+
+  if( argc >= 4 && strcmp( argv[1], "addrs" ) == 0 )
+    {
+    const long lines = atol( argv[2] );
+    long count = atol( argv[3] );
+    if( argc > 4 ) rng_state += strtoull( argv[4], 0, 10 );
+    if( lines <= 0 ) return 1;
+    while( count-- > 0 ) printf( "%llup\n", rnd() % lines + 1 );
+    puts( "Q" );
+    return 0;
+    }
+  if( argc < 3 || ( size = parse_size( argv[2] ) ) < 0 )
+    {
+    fputs( "Usage: gencorpus {cpp|log|giant|binary|crlf} size [seed]\n"
+           "       gencorpus addrs lines count [seed]\n", stderr );
+    return 1;
+    }
+  if( argc > 3 ) rng_state += strtoull( argv[3], 0, 10 );
+  if( by_lines && ( strcmp( argv[1], "giant" ) == 0 ||
+                    strcmp( argv[1], "binary" ) == 0 ) )
+    { fprintf( stderr, "gencorpus: '%s' has no size in lines\n", argv[1] );
+      return 1; }
+  if( strcmp( argv[1], "giant" ) == 0 && size > 0 ) --size;	/* newline */
+  while( done < size )
+    {
+    int n, i;
+    if( strcmp( argv[1], "cpp" ) == 0 ) n = cpp_line( buf );
+    else if( strcmp( argv[1], "log" ) == 0 ) n = log_line( buf );
+    else if( strcmp( argv[1], "crlf" ) == 0 ) n = crlf_line( buf );
+    else if( strcmp( argv[1], "giant" ) == 0 )
+      { for( n = 0; n < (int)sizeof buf; ++n ) buf[n] = 'a' + rnd_below( 26 ); }
+    else if( strcmp( argv[1], "binary" ) == 0 )
+      { for( n = 0; n < (int)sizeof buf; ++n )
+          { i = rnd_below( 8 ); buf[n] = ( i == 0 ) ? 0 : ( i == 1 ) ? '\n' : rnd(); } }
+    else { fprintf( stderr, "gencorpus: unknown kind '%s'\n", argv[1] ); return 1; }
+    if( by_lines )			/* a cpp_line may be two lines */
+      { if( (int)fwrite( buf, 1, n, stdout ) != n ) return 1;
+        for( i = 0; i < n; ++i ) if( buf[i] == '\n' ) ++done;
+        continue; }
+    if( n > size - done ) n = size - done;
+    if( (int)fwrite( buf, 1, n, stdout ) != n ) return 1;
+    done += n;
+    }
+  if( strcmp( argv[1], "giant" ) == 0 ) putchar( '\n' );
+  return 0;
+  }
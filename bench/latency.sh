@@ -0,0 +1,33 @@
+#!/bin/sh
+# latency.sh: interactive latency of ed on corpora of several sizes.
+# Copyright (C) 2022 Mathias Fuchs
+# This file is free software; you have unlimited permission to copy,
+# distribute and modify it.
+#
+# Usage: bench/latency.sh [ed]
+# Run ptylat on a corpus of each kind and size; see bench/ptylat.c for
+# the commands typed and the CSV written.
+#
+# Environment:
+#   LATENCY_ITERATIONS  commands of each kind per corpus (default 1000)
+#   BENCH_KINDS         corpus kinds (default "cpp log")
+#   BENCH_SIZES         corpus sizes (default "1M 16M 64M")
+#   BENCH_DIR           where corpora go (default /tmp/ed-bench)
+
+ed=${1:-./ed}
+dir=$(dirname "$0")
+kinds=${BENCH_KINDS:-"cpp log"}
+sizes=${BENCH_SIZES:-"1M 16M 64M"}
+work=${BENCH_DIR:-/tmp/ed-bench}
+
+mkdir -p "$work" || exit 1
+
+. "$dir/workloads.sh"
+
+files=
+for size in $sizes ; do
+  for kind in $kinds ; do
+    files="$files $(corpus $kind $size)" || exit 1
+  done
+done
+"$dir/ptylat" -n ${LATENCY_ITERATIONS:-1000} "$ed" $files
@@ -0,0 +1,192 @@
+/* micro.c: microbenchmarks of the buffer and scratch file routines. */
+/* GNU ed - The GNU line editor.
+   Copyright (C) 2022 Mathias Fuchs
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+   Usage: micro [lines...]
+   Link with the object files of ed except main.o. For each buffer size
+   (default 1000 10000 100000 1000000 lines) time the core routines and
+   print CSV lines "benchmark,lines,ops,ns_per_op". Each benchmark runs
+   until about 0.2 s have passed, so the O(n) ones do fewer operations on
+   big buffers.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/ed.h"
+
+
+/* main.c is not linked; provide its access functions */
+bool extended_regexp( void ) { return false; }
+bool json_output( void ) { return false; }
+bool is_regular_file( const int fd ) { return true; }
+bool may_access_filename( const char * const name ) { return true; }
+bool restricted( void ) { return false; }
+bool scripted( void ) { return true; }
+bool strip_cr( void ) { return false; }
+bool traditional( void ) { return false; }
+void show_strerror( const char * const filename, const int errcode )
+  { fprintf( stderr, "micro: %s: error %d\n", filename ? filename : "", errcode ); }
+
+
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static int rnd_below( const int n )
+  {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state % n;
+  }
+
+
+static double now( void )
+  {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+  }
+
+
+static void report( const char * const name, const int lines,
+                    const long ops, const double secs )
+  { printf( "%s,%d,%ld,%.1f\n", name, lines, ops, secs * 1e9 / ops ); }
+
+
+/* Run op( i ) for i = 0, 1, ... in batches until 0.2 s have passed. */
+static void run( const char * const name, const int lines,
+                 void (*op)( const long i ) )
+  {
+  const double start = now();
+  double elapsed;
+  long ops = 0, batch = 1;
+
+  do {
+    long i;
+    for( i = 0; i < batch; ++i ) op( ops + i );
+    ops += batch; if( batch < 65536 ) batch *= 2;
+    elapsed = now() - start;
+    }
+  while( elapsed < 0.2 );
+  report( name, lines, ops, elapsed );
+  }
+
+
+static int n_lines;			/* lines in the buffer */
+static const line_t ** nodes;		/* nodes of the buffer, by address */
+static volatile long sink;		/* keeps results alive */
+
+static void seq_search( const long i )
+  { sink += search_line_node( i % n_lines + 1 )->len; }
+
+static void random_search( const long i )
+  { sink += search_line_node( rnd_below( n_lines ) + 1 )->len; }
+
+static void alternating_search( const long i )
+  { sink += search_line_node( ( i & 1 ) ? n_lines - ( i / 2 ) % n_lines :
+                                          ( i / 2 ) % n_lines + 1 )->len; }
+
+static void node_addr( const long i )
+  { sink += get_line_node_addr( nodes[rnd_below( n_lines )] ); }
+
+static void seq_read( const long i )
+  { sink += get_sbuf_line( nodes[i % n_lines] )[0]; }
+
+static void random_read( const long i )
+  { sink += get_sbuf_line( nodes[rnd_below( n_lines )] )[0]; }
+
+static void write_line( const long i )
+  {
+  static const char text[] = "a line of the size of a short line of code\n";
+  set_current_addr( last_addr() );
+  if( !put_sbuf_line( text, sizeof text - 1 ) ) exit( 1 );
+  }
+
+static void push_undo( const long i )
+  {
+  if( i % 1024 == 0 ) clear_undo_stack();
+  if( !push_undo_atom( UADD, i % n_lines + 1, i % n_lines + 1 ) ) exit( 1 );
+  }
+
+static void delete_undo( const long i )
+  {
+  const int addr = rnd_below( n_lines ) + 1;
+  clear_undo_stack();
+  if( !delete_lines( addr, addr, false ) || !undo( false ) ) exit( 1 );
+  }
+
+static void resize( const long i )
+  {
+  char * buf = 0;
+  int size = 0;
+  unsigned min_size;
+  for( min_size = 1; min_size <= 1U << 20; min_size *= 2 )
+    if( !resize_buffer( &buf, &size, min_size + i % 2 ) ) exit( 1 );
+  free( buf );
+  }
+
+
+/* build a buffer of 'lines' lines of about 40 bytes */
+static void fill_buffer( const int lines )
+  {
+  char text[64];
+  int addr;
+
+  if( last_addr() > 0 && !delete_lines( 1, last_addr(), false ) ) exit( 1 );
+  clear_undo_stack();
+  for( addr = 0; addr < lines; ++addr )
+    {
+    const int len = snprintf( text, sizeof text, "line %d of the buffer %d\n",
+                              addr + 1, rnd_below( 1000000 ) );
+    set_current_addr( addr );
+    if( !put_sbuf_line( text, len ) ) exit( 1 );
+    }
+  nodes = (const line_t **)realloc( nodes, lines * sizeof *nodes );
+  if( !nodes ) exit( 1 );
+  for( addr = 0; addr < lines; ++addr )
+    nodes[addr] = search_line_node( addr + 1 );
+  n_lines = lines;
+  }
+
+
+int main( const int argc, const char * const argv[] )
+  {
+  static const int default_sizes[] = { 1000, 10000, 100000, 1000000 };
+  const int nsizes = ( argc > 1 ) ? argc - 1 : 4;
+  int i;
+
+  if( !init_buffers() ) return 1;
+  puts( "benchmark,lines,ops,ns_per_op" );
+  for( i = 0; i < nsizes; ++i )
+    {
+    const int lines = ( argc > 1 ) ? atoi( argv[i+1] ) : default_sizes[i];
+    if( lines <= 0 ) { fprintf( stderr, "micro: bad size\n" ); return 1; }
+    fill_buffer( lines );
+    run( "search_line_node_seq", lines, seq_search );
+    run( "search_line_node_random", lines, random_search );
+    run( "search_line_node_alternating", lines, alternating_search );
+    run( "get_line_node_addr", lines, node_addr );
+    run( "get_sbuf_line_seq", lines, seq_read );
+    run( "get_sbuf_line_random", lines, random_read );
+    run( "push_undo_atom", lines, push_undo );
+    run( "delete_lines_undo", lines, delete_undo );
+    run( "put_sbuf_line", lines, write_line );	/* grows the buffer */
+    }
+  run( "resize_buffer_1M", 0, resize );
+  return 0;
+  }
@@ -0,0 +1,201 @@
+/* ptylat.c: keystroke-to-output latency of ed on a pseudo-terminal. */
+/* GNU ed - The GNU line editor.
+   Copyright (C) 2022 Mathias Fuchs
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+   Usage: ptylat [-n iterations] ed file...
+   Run 'ed -p PROMPT file' on a 24x80 pseudo-terminal for each file, and
+   type 'Np', 'Nz', '/word/' and 'Nn' commands (N a random line) at it as
+   a user would. For each command measure the time from writing the
+   command line to the first byte of output (ttfb) and to the next prompt
+   (ttlb), which includes highlighting and the flushes of main_loop. Print
+   one CSV line "file,lines,command,iterations,ttfb_p50_us,ttfb_p99_us,
+   ttlb_p50_us,ttlb_p99_us" per file and command.
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+static const char prompt[] = "<ptylat>";
+enum { prompt_len = sizeof prompt - 1 };
+
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static long rnd_below( const long n )
+  {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state % n;
+  }
+
+
+static double now( void )
+  {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+  }
+
+
+static long count_lines( const char * const name )
+  {
+  FILE * const fp = fopen( name, "r" );
+  long lines = 0;
+  int c;
+  if( !fp ) return -1;
+  while( ( c = getc( fp ) ) != EOF ) if( c == '\n' ) ++lines;
+  fclose( fp );
+  return lines;
+  }
+
+
+/* Read from the terminal until the output ends with the prompt.
+   Store the time of the first byte in *first. Return false on EOF. */
+static bool wait_prompt( const int fd, double * const first )
+  {
+  char buf[65536];
+  char tail[prompt_len];
+  int tail_len = 0;
+
+  if( first ) *first = 0;
+  while( true )
+    {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    int n;
+    if( poll( &pfd, 1, 60000 ) <= 0 ) return false;	/* hung */
+    n = read( fd, buf, sizeof buf );
+    if( n < 0 && errno == EINTR ) continue;
+    if( n <= 0 ) return false;
+    if( first && *first == 0 ) *first = now();
+    /* keep the last prompt_len bytes seen */
+    if( n >= prompt_len )
+      { memcpy( tail, buf + n - prompt_len, prompt_len ); tail_len = prompt_len; }
+    else
+      {
+      const int keep = ( tail_len + n > prompt_len ) ? prompt_len - n : tail_len;
+      memmove( tail, tail + tail_len - keep, keep );
+      memcpy( tail + keep, buf, n ); tail_len = keep + n;
+      }
+    if( tail_len == prompt_len && memcmp( tail, prompt, prompt_len ) == 0 )
+      return true;
+    }
+  }
+
+
+static int compare_doubles( const void * a, const void * b )
+  {
+  const double x = *(const double *)a, y = *(const double *)b;
+  return ( x > y ) - ( x < y );
+  }
+
+static double percentile( double * const v, const int n, const int p )
+  {
+  qsort( v, n, sizeof *v, compare_doubles );
+  return v[( n - 1 ) * p / 100];
+  }
+
+
+/* Run 'iterations' commands of the kind 'cmd' on 'file'. */
+static bool measure( const char * const ed, const char * const file,
+                     const long lines, const char * const cmd,
+                     const int iterations )
+  {
+  static const char * const words[] =
+    { "buffer", "scratch", "undo", "regex", "ERROR", "yank", "global" };
+  struct winsize ws = { 24, 80, 0, 0 };
+  struct termios tio;
+  double * const ttfb = (double *)malloc( iterations * sizeof *ttfb );
+  double * const ttlb = (double *)malloc( iterations * sizeof *ttlb );
+  bool started;
+  int fd, i, status;
+  pid_t pid;
+
+  if( !ttfb || !ttlb ) { fputs( "ptylat: out of memory\n", stderr ); return false; }
+  pid = forkpty( &fd, 0, 0, &ws );
+  if( pid < 0 ) { perror( "ptylat: forkpty" ); return false; }
+  if( pid == 0 )
+    {
+    execlp( ed, ed, "-p", prompt, file, (char *)0 );
+    perror( ed ); _exit( 127 );
+    }
+  /* the typed commands must not come back as output */
+  if( tcgetattr( fd, &tio ) == 0 )
+    { tio.c_lflag &= ~ECHO; tcsetattr( fd, TCSANOW, &tio ); }
+  started = wait_prompt( fd, 0 );	/* byte count of the file read */
+  if( !started ) fprintf( stderr, "ptylat: %s did not start\n", ed );
+  for( i = 0; started && i < iterations; ++i )
+    {
+    char line[64];
+    const long addr = ( lines > 0 ) ? rnd_below( lines ) + 1 : 0;
+    double t0, first;
+    int len;
+    if( cmd[0] == '/' )
+      len = snprintf( line, sizeof line, "/%s/\n", words[rnd_below( 7 )] );
+    else len = snprintf( line, sizeof line, "%ld%s\n", addr, cmd );
+    t0 = now();
+    if( write( fd, line, len ) != len || !wait_prompt( fd, &first ) )
+      { fprintf( stderr, "ptylat: %s stopped responding\n", ed ); break; }
+    ttfb[i] = ( first - t0 ) * 1e6;
+    ttlb[i] = ( now() - t0 ) * 1e6;
+    }
+  if( write( fd, "Q\n", 2 ) != 2 ) kill( pid, SIGTERM );
+  close( fd );
+  waitpid( pid, &status, 0 );
+  if( i > 0 )
+    {
+    const double fb50 = percentile( ttfb, i, 50 ), fb99 = percentile( ttfb, i, 99 );
+    const double lb50 = percentile( ttlb, i, 50 ), lb99 = percentile( ttlb, i, 99 );
+    printf( "%s,%ld,%s,%d,%.0f,%.0f,%.0f,%.0f\n", file, lines,
+            ( cmd[0] == '/' ) ? "/re/" : cmd, i, fb50, fb99, lb50, lb99 );
+    fflush( stdout );
+    }
+  free( ttfb ); free( ttlb );
+  return i == iterations;
+  }
+
+
+int main( const int argc, char * const argv[] )
+  {
+  static const char * const commands[] = { "p", "z", "/", "n" };
+  int iterations = 1000, argind = 1, i, j;
+
+  if( argc > 2 && strcmp( argv[1], "-n" ) == 0 )
+    { iterations = atoi( argv[2] ); argind = 3; }
+  if( iterations <= 0 || argc - argind < 2 )
+    { fputs( "Usage: ptylat [-n iterations] ed file...\n", stderr ); return 1; }
+  puts( "file,lines,command,iterations,ttfb_p50_us,ttfb_p99_us,ttlb_p50_us,ttlb_p99_us" );
+  for( i = argind + 1; i < argc; ++i )
+    {
+    const long lines = count_lines( argv[i] );
+    if( lines < 0 ) { perror( argv[i] ); return 1; }
+    for( j = 0; j < 4; ++j )
+      if( !measure( argv[argind], argv[i], lines, commands[j], iterations ) )
+        return 1;
+    }
+  return 0;
+  }
@@ -0,0 +1,71 @@
+/* runbench.c: run a command and report its time and peak memory. */
+/* GNU ed - The GNU line editor.
+   Copyright (C) 2022 Mathias Fuchs
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+   Usage: runbench label input output command [args...]
+   Run command with stdin from 'input' and stdout to 'output', and print
+   one CSV line "label,exit_status,wall_s,user_s,sys_s,maxrss_kb".
+   stderr is left alone.
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+
+static double seconds( const struct timeval tv )
+  { return tv.tv_sec + tv.tv_usec / 1e6; }
+
+
+int main( const int argc, char * const argv[] )
+  {
+  struct timespec t0, t1;
+  struct rusage ru;
+  int status;
+  pid_t pid;
+
+  if( argc < 5 )
+    {
+    fputs( "Usage: runbench label input output command [args...]\n", stderr );
+    return 1;
+    }
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  pid = fork();
+  if( pid < 0 ) { perror( "runbench: fork" ); return 1; }
+  if( pid == 0 )
+    {
+    const int in = open( argv[2], O_RDONLY );
+    const int out = open( argv[3], O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if( in < 0 || out < 0 || dup2( in, 0 ) < 0 || dup2( out, 1 ) < 0 )
+      { perror( "runbench" ); _exit( 127 ); }
+    execvp( argv[4], argv + 4 );
+    perror( argv[4] ); _exit( 127 );
+    }
+  if( wait4( pid, &status, 0, &ru ) != pid )
+    { perror( "runbench: wait4" ); return 1; }
+  clock_gettime( CLOCK_MONOTONIC, &t1 );
+  printf( "%s,%d,%.6f,%.6f,%.6f,%ld\n", argv[1],
+          WIFEXITED( status ) ? WEXITSTATUS( status ) : 128 + WTERMSIG( status ),
+          ( t1.tv_sec - t0.tv_sec ) + ( t1.tv_nsec - t0.tv_nsec ) / 1e9,
+          seconds( ru.ru_utime ), seconds( ru.ru_stime ), ru.ru_maxrss );
+  return 0;
+  }
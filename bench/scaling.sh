@@ -0,0 +1,102 @@
+#!/bin/sh
+# scaling.sh: time and peak memory of the benchmark workloads as a
+# function of the number of lines in the buffer.
+# Copyright (C) 2022 Mathias Fuchs
+# This file is free software; you have unlimited permission to copy,
+# distribute and modify it.
+#
+# Usage: bench/scaling.sh [ed]
+# For each workload, run it on buffers of 10^3 lines up to SCALE_MAX lines,
+# with SCALE_STEPS sizes per decade, and write one CSV line per run:
+#   kind,workload,lines,bytes,exit_status,wall_s,maxrss_kb,
+#   time_slope,rss_slope
+# The slopes are d log(y) / d log(lines) from the previous size: about 1
+# for linear work, 2 for quadratic (e.g. an O(n) walk per line in 'g'),
+# and 0 for constant. Once a workload takes more than SCALE_LIMIT seconds
+# the bigger sizes are skipped for it. Each corpus is deleted after use.
+# At the end a least-squares fit of the exponents over all sizes is
+# written to stderr.
+#
+# Environment:
+#   SCALE_KINDS      corpus kinds (default "cpp"; cpp, log or crlf)
+#   SCALE_MAX        largest number of lines (default 100000000)
+#   SCALE_STEPS      sizes per decade: 1 (10^k), 2 (1, 3) or 3 (1, 2, 5)
+#                    (default 3)
+#   SCALE_LIMIT      seconds after which a workload stops growing (default 60)
+#   BENCH_WORKLOADS  workloads (default all, see workloads.sh)
+#   BENCH_DIR        where corpora and scripts go (default /tmp/ed-bench)
+
+ed=${1:-./ed}
+dir=$(dirname "$0")
+kinds=${SCALE_KINDS:-cpp}
+max=${SCALE_MAX:-100000000}
+limit=${SCALE_LIMIT:-60}
+work=${BENCH_DIR:-/tmp/ed-bench}
+
+case ${SCALE_STEPS:-3} in
+  1) mantissas="1" ;;
+  2) mantissas="1 3" ;;
+  3) mantissas="1 2 5" ;;
+  *) echo "SCALE_STEPS must be 1, 2 or 3" >&2; exit 1 ;;
+esac
+
+mkdir -p "$work" || exit 1
+
+. "$dir/workloads.sh"
+workloads=${BENCH_WORKLOADS:-$all_workloads}
+
+sizes=
+decade=1000
+while [ $decade -le $max ] ; do
+  for m in $mantissas ; do
+    [ $(( m * decade )) -le $max ] && sizes="$sizes $(( m * decade ))"
+  done
+  decade=$(( decade * 10 ))
+done
+
+# add the slopes from the previous size, and fit log(y) = a + b log(lines)
+fit() {
+  awk -F, -v OFS=, '
+    function slope( y, py ) {
+      return ( y > 0 && py > 0 ) ? sprintf( "%.2f", log( y / py ) / lx_step ) : "" }
+    { key = $1 "," $2; x = log( $3 ); t = $6; r = $7
+      if( !( key in seen ) ) { seen[key] = 1; keys[++nkeys] = key }
+      ts = rs = ""
+      if( key in px ) { lx_step = x - px[key]
+                        ts = slope( t, pt[key] ); rs = slope( r, pr[key] ) }
+      print $0, ts, rs
+      px[key] = x; pt[key] = t; pr[key] = r
+      if( t > 0 && r > 0 )
+        { ++n[key]; sx[key] += x; sxx[key] += x * x
+          st[key] += log( t ); sxt[key] += x * log( t )
+          sr[key] += log( r ); sxr[key] += x * log( r ) } }
+    END {
+      for( i = 1; i <= nkeys; ++i )
+        { k = keys[i]; d = n[k] * sxx[k] - sx[k] * sx[k]
+          if( n[k] < 2 || d == 0 ) continue
+          printf( "%s: time ~ lines^%.2f, rss ~ lines^%.2f\n", k,
+                  ( n[k] * sxt[k] - sx[k] * st[k] ) / d,
+                  ( n[k] * sxr[k] - sx[k] * sr[k] ) / d ) > "/dev/stderr" } }'
+}
+
+echo "kind,workload,lines,bytes,exit_status,wall_s,maxrss_kb,time_slope,rss_slope"
+for kind in $kinds ; do
+  stopped=
+  for lines in $sizes ; do
+    corpus=$(corpus $kind ${lines}l) || exit 1
+    bytes=$(wc -c < "$corpus")
+    for wl in $workloads ; do
+      case " $stopped " in *" $wl "*) continue ;; esac
+      script $wl $lines > "$work/script.ed" || exit 1
+      # label,exit,wall,user,sys,rss -> kind,wl,lines,bytes,exit,wall,rss
+      result=$("$dir/runbench" "$kind,$wl,$lines,$bytes" "$work/script.ed" \
+               /dev/null "$ed" -s "$corpus" | cut -d, -f1-6,9)
+      echo "$result"
+      wall=$(echo "$result" | cut -d, -f6)
+      awk -v t="$wall" -v l="$limit" 'BEGIN { exit !( t > l ) }' &&
+        stopped="$stopped $wl"
+    done
+    rm -f "$corpus"
+  done
+done | fit
+rm -f "$work/out" "$work/script.ed"
@@ -0,0 +1,32 @@
+# workloads.sh: ed scripts of the benchmark workloads; sourced by the
+# benchmark drivers, which set $dir (where gencorpus is) and $work.
+# Copyright (C) 2022 Mathias Fuchs
+# This file is free software; you have unlimited permission to copy,
+# distribute and modify it.
+
+all_workloads="load write addr search gdel subst copy move undo print"
+
+# write the ed script for workload $1 on a buffer of $2 lines to stdout
+script() {
+  half=$(( $2 / 2 )); [ $half -gt 0 ] || half=1
+  case $1 in
+    load)  echo Q ;;
+    write) printf 'w %s\nQ\n' "$work/out" ;;
+    addr)  "$dir/gencorpus" addrs "$2" 10000 ;;
+    search) awk 'BEGIN { for( i = 0; i < 1000; ++i ) print "/ERROR\\|buffer/"
+                         print "Q" }' ;;
+    gdel)  printf 'g/e/d\nQ\n' ;;
+    subst) printf ',s/e/E/g\nQ\n' ;;
+    copy)  printf '1,%dt$\nQ\n' $half ;;
+    move)  printf '1,%dm$\nQ\n' $half ;;
+    undo)  printf ',s/e/E/g\nu\nQ\n' ;;
+    print) printf ',p\nQ\n' ;;
+    *)     echo "unknown workload '$1'" >&2; return 1 ;;
+  esac
+}
+
+# generate corpus $1 of size $2 if it is not there yet; print its name
+corpus() {
+  [ -f "$work/$1-$2" ] || "$dir/gencorpus" $1 $2 > "$work/$1-$2" || return 1
+  echo "$work/$1-$2"
+}
@@ -0,0 +1,213 @@
+/* autosave.c: periodic background autosave for the ed line editor. */
+/* GNU ed - The GNU line editor.
+   Copyright (C) 2022 Mathias Fuchs
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+   Text in the scratch file is never overwritten, so the position and
+   length of each line are a snapshot of the buffer that stays valid
+   while ed goes on editing. Between commands, if the buffer has changed
+   and a save is due, the main thread copies the line descriptors and a
+   thread writes the text to '<file>.autosave' (or 'ed.autosave') with
+   pread on the scratch file. The thread is joined before the scratch
+   file is closed.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ed.h"
+
+
+static int interval = 0;		/* seconds between saves; 0 = off */
+static unsigned long max_changes = 0;	/* changes that force a save */
+static unsigned long saved_generation = 0;	/* of the last snapshot */
+static time_t saved_time;		/* of the last snapshot */
+static bool have_file = false;		/* we have written an autosave file */
+static bool registered = false;		/* remove_autosave is run at exit */
+
+static pthread_t thread;
+static bool running = false;		/* thread not joined yet */
+static span_t * descs = 0;		/* snapshot, owned by the thread */
+static int descs_size = 0;		/* lines allocated in descs */
+static int ndescs = 0;
+static bool unterminated = false;	/* no newline after the last line */
+static int sfd = -1;			/* scratch file */
+static char * name = 0;			/* autosave file */
+static int save_errno = 0;		/* set by the thread on failure */
+static atomic_int finished = 0;		/* set by the thread at its end */
+
+
+bool set_autosave( const char * const arg, const bool changes )
+  {
+  char * tail;
+  const long n = strtol( arg, &tail, 10 );
+  if( tail == arg || *tail || n <= 0 || n > 1000000 ) return false;
+  if( changes ) max_changes = n; else interval = n;
+  if( !max_changes ) max_changes = 1000;	/* defaults of each other */
+  if( !interval ) interval = 60;
+  saved_time = time( 0 );
+  if( !registered ) { atexit( remove_autosave ); registered = true; }
+  return true;
+  }
+
+
+/* Return the name of the autosave file for filename in a new buffer. */
+static char * autosave_name( const char * const filename )
+  {
+  static const char suffix[] = ".autosave";
+  const char * const base = ( filename && filename[0] ) ? filename : "ed";
+  char * const s = (char *)malloc( strlen( base ) + sizeof suffix );
+  if( s ) { strcpy( s, base ); strcat( s, suffix ); }
+  return s;
+  }
+
+
+static void * write_snapshot( void * arg )
+  {
+  enum { bufsz = 65536 };
+  char * const buf = (char *)malloc( bufsz );
+  char * const tmp = (char *)malloc( strlen( name ) + 2 );
+  FILE * fp = 0;
+  int fd, i;
+
+  if( arg ) {}				/* keep compiler happy */
+  save_errno = 0;
+  if( !buf || !tmp ) { save_errno = ENOMEM; goto done; }
+  strcpy( tmp, name ); strcat( tmp, "~" );
+  fd = open( tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600 );	/* private */
+  if( fd >= 0 && !( fp = fdopen( fd, "w" ) ) ) close( fd );
+  if( !fp ) { save_errno = errno; goto done; }
+  for( i = 0; i < ndescs; ++i )
+    {
+    long pos = descs[i].pos;
+    int len = descs[i].len;
+    while( len > 0 )
+      {
+      const int n = pread( sfd, buf, min( len, bufsz ), pos );
+      if( n <= 0 ) { save_errno = n ? errno : EIO; goto done; }
+      if( (int)fwrite( buf, 1, n, fp ) != n ) { save_errno = errno; goto done; }
+      pos += n; len -= n;
+      }
+    if( ( i < ndescs - 1 || !unterminated ) && putc( '\n', fp ) == EOF )
+      { save_errno = errno; goto done; }
+    }
+  if( fclose( fp ) != 0 ) save_errno = errno;
+  fp = 0;
+  if( !save_errno && rename( tmp, name ) != 0 ) save_errno = errno;
+done:
+  if( fp ) fclose( fp );
+  if( save_errno && tmp ) unlink( tmp );
+  free( tmp ); free( buf );
+  atomic_store( &finished, 1 );
+  return 0;
+  }
+
+
+/* Wait for the autosave thread to end. Called before the scratch file
+   is closed. */
+void join_autosave( void )
+  {
+  if( !running ) return;
+  pthread_join( thread, 0 );
+  running = false;
+  if( save_errno )
+    fprintf( stderr, "%s: autosave failed: %s\n", name, strerror( save_errno ) );
+  else have_file = true;
+  }
+
+
+/* Copy the line descriptors and start a thread writing them. */
+static void start_snapshot( void )
+  {
+  sigset_t set, old;
+  join_autosave();
+  sfd = sbuf_fd();
+  if( sfd < 0 || !copy_spans( 1, last_addr(), &descs, &descs_size ) ) return;
+  ndescs = last_addr();
+  unterminated = isbinary() && unterminated_last_line();
+  free( name );
+  name = autosave_name( strip_escapes( get_def_filename() ) );
+  if( !name ) return;
+  saved_generation = buffer_generation();
+  saved_time = time( 0 );
+  atomic_store( &finished, 0 );
+  sigfillset( &set );			/* signals go to the main thread */
+  pthread_sigmask( SIG_SETMASK, &set, &old );
+  running = pthread_create( &thread, 0, write_snapshot, 0 ) == 0;
+  pthread_sigmask( SIG_SETMASK, &old, 0 );
+  }
+
+
+/* Remove the autosave file, if ours. Called when the buffer is saved
+   and at exit. */
+void remove_autosave( void )
+  {
+  join_autosave();
+  if( have_file && name ) unlink( name );
+  have_file = false;
+  }
+
+
+/* Called while waiting for input. Start a save if the buffer has
+   changed and the interval has passed or enough changes have been made;
+   if a save will become due, wait for it with poll on stdin. */
+void autosave( void )
+  {
+  if( !interval ) return;
+  if( running )
+    {
+    if( !atomic_load( &finished ) ) return;	/* previous one still being written */
+    join_autosave();
+    }
+  if( !modified() ) { if( have_file ) remove_autosave(); return; }
+  while( buffer_generation() != saved_generation )
+    {
+    const time_t now = time( 0 );
+    struct pollfd pfd = { 0, POLLIN, 0 };
+    if( buffer_generation() - saved_generation >= max_changes ||
+        now - saved_time >= interval )
+      { start_snapshot(); return; }
+    if( poll( &pfd, 1, ( saved_time + interval - now ) * 1000 ) != 0 ) return;
+    }
+  }
+
+
+/* Tell the user if an autosave file newer than filename (or for no
+   file, if filename is 0) exists. */
+void offer_recovery( const char * const filename )
+  {
+  struct stat st, ast;
+  char * const s = autosave_name( filename );
+  if( s && stat( s, &ast ) == 0 )
+    {
+    if( !filename || !filename[0] )
+      fprintf( stderr, "%s exists; 'r %s' recovers it\n", s, s );
+    else if( stat( filename, &st ) != 0 || ast.st_mtime >= st.st_mtime )
+      fprintf( stderr, "%s is newer than %s; to recover, 'e %s' and "
+               "'w %s'\n", s, filename, s, filename );
+    }
+  free( s );
+  }
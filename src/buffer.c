@@ -22,23 +22,34 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/file.h>
 #include <sys/stat.h>
 
 #include "ed.h"
+#include "probes.h"
 
 
 static int current_addr_ = 0;	/* current address in editor buffer */
 static int last_addr_ = 0;	/* last address in editor buffer */
 static bool isbinary_ = false;	/* if set, buffer contains ASCII NULs */
 static bool modified_ = false;	/* if set, buffer modified since last write */
+static unsigned long generation_ = 0;	/* incremented by every change */
 
-static bool seek_write = false;	/* seek before writing */
+enum { sbuf_block = 65536, rbuf_block = 8192 };
 static FILE * sfp = 0;		/* scratch file pointer */
-static long sfpos = 0;		/* scratch file position */
+static int sfd = -1;		/* its descriptor, for pread and pwrite */
+static long sfpos = 0;		/* end of scratch file, including wbuf */
+static char wbuf[sbuf_block];	/* text appended but not yet written */
+static int wlen = 0;
+static char rbuf[rbuf_block];	/* a block of the scratch file */
+static long rpos = 0;		/* scratch file position of rbuf */
+static int rlen = 0;
+static long next_read = 0;	/* position after the last line read */
 static line_t buffer_head;	/* editor buffer ( linked list of line_t )*/
 static line_t yank_buffer_head;
+static long yank_bytes = 0;	/* text length of lines in yank buffer */
 
 
 int current_addr( void ) { return current_addr_; }
@@ -54,6 +65,9 @@ void set_binary( void ) { isbinary_ = true; }
 
 bool modified( void ) { return modified_; }
 void set_modified( const bool m ) { modified_ = m; }
+static void mark_modified( void ) { modified_ = true; ++generation_; }
+
+unsigned long buffer_generation( void ) { return generation_; }
 
 
 int inc_addr( int addr )
@@ -90,6 +104,7 @@ static void add_line_node( line_t * const lp )
   insert_node( lp, prev );
   ++current_addr_;
   ++last_addr_;
+  mem_stats.scratch_live += lp->len;
   }
 
 
@@ -97,12 +112,14 @@ static void add_line_node( line_t * const lp )
 static line_t * dup_line_node( line_t * const lp )
   {
   line_t * const p = (line_t *) malloc( sizeof (line_t) );
+  ++counters.allocs;
   if( !p )
     {
     show_strerror( 0, errno );
     set_error_msg( mem_msg );
     return 0;
     }
+  ++mem_stats.nodes;
   if( lp ) { p->pos = lp->pos; p->len = lp->len; }
   return p;
   }
@@ -144,7 +161,7 @@ bool append_lines( const char ** const ibufpp, const int addr,
       if( !up ) { enable_interrupts(); return false; }
       }
     *ibufpp += size;
-    modified_ = true;
+    mark_modified();
     enable_interrupts();
     }
   }
@@ -162,6 +179,8 @@ static void clear_yank_buffer( void )
     free( lp );
     lp = p;
     }
+  mem_stats.nodes -= mem_stats.yank_nodes;
+  mem_stats.yank_nodes = 0;
   enable_interrupts();
   }
 
@@ -169,8 +188,9 @@ static void clear_yank_buffer( void )
 /* close scratch file */
 bool close_sbuf( void )
   {
+  join_autosave();			/* it reads the scratch file */
   clear_yank_buffer();
-  clear_undo_stack();
+  reset_undo_state();
   if( sfp )
     {
     if( fclose( sfp ) != 0 )
@@ -179,10 +199,13 @@ bool close_sbuf( void )
       set_error_msg( "Cannot close temp file" );
       return false;
       }
-    sfp = 0;
+    sfp = 0; sfd = -1;
     }
-  sfpos = 0;
-  seek_write = false;
+  sfpos = 0; wlen = 0; rlen = 0; next_read = 0;
+  mem_stats.scratch_size = 0;
+  clear_highlight_cache();		/* keyed by scratch position */
+  clear_lexer();
+  clear_snapshots();
   return true;
   }
 
@@ -204,7 +227,7 @@ bool copy_lines( const int first_addr, const int second_addr, const int addr )
   for( ; n > 0; n = m, m = 0, np = search_line_node( current_addr_ + 1 ) )
     for( ; n-- > 0; np = np->q_forw )
       {
-      if( too_many_lines() ) return false;
+      if( too_many_lines() || interrupted() ) return false;
       disable_interrupts();
       lp = dup_line_node( np );
       if( !lp ) { enable_interrupts(); return false; }
@@ -215,13 +238,67 @@ bool copy_lines( const int first_addr, const int second_addr, const int addr )
         up = push_undo_atom( UADD, current_addr_, current_addr_ );
         if( !up ) { enable_interrupts(); return false; }
         }
-      modified_ = true;
+      mark_modified();
       enable_interrupts();
       }
   return true;
   }
 
 
+/* Store the text positions of lines from to to in *spansp, growing it
+   as needed. Return false if error. */
+bool copy_spans( const int from, const int to, span_t ** const spansp,
+                 int * const sizep )
+  {
+  const line_t * lp = search_line_node( from );
+  const int n = to - from + 1;
+  int i;
+
+  if( *sizep < n || !*spansp )
+    {
+    span_t * const p = (span_t *)realloc( *spansp, max( n, 1 ) * sizeof *p );
+    ++counters.allocs;
+    if( !p ) { show_strerror( 0, errno ); set_error_msg( mem_msg ); return false; }
+    *spansp = p; *sizep = max( n, 1 );
+    }
+  for( i = 0; i < n; ++i, lp = lp->q_forw )
+    { (*spansp)[i].pos = lp->pos; (*spansp)[i].len = lp->len; }
+  return true;
+  }
+
+
+/* Replace the contents of the buffer with n lines of text already in the
+   scratch file. Return false if error. */
+bool replace_buffer( const span_t * const spans, const int n,
+                     const bool isglobal )
+  {
+  undo_t * up = 0;
+  int i;
+
+  if( last_addr_ > 0 && !delete_lines( 1, last_addr_, isglobal ) )
+    return false;
+  current_addr_ = 0;
+  for( i = 0; i < n; ++i )
+    {
+    if( too_many_lines() || interrupted() ) return false;
+    disable_interrupts();
+    line_t * const lp = dup_line_node( 0 );
+    if( !lp ) { enable_interrupts(); return false; }
+    lp->pos = spans[i].pos; lp->len = spans[i].len;
+    add_line_node( lp );
+    if( up ) up->tail = lp;
+    else
+      {
+      up = push_undo_atom( UADD, current_addr_, current_addr_ );
+      if( !up ) { enable_interrupts(); return false; }
+      }
+    mark_modified();
+    enable_interrupts();
+    }
+  return true;
+  }
+
+
 /* delete a range of lines */
 bool delete_lines( const int from, const int to, const bool isglobal )
   {
@@ -236,8 +313,9 @@ bool delete_lines( const int from, const int to, const bool isglobal )
   if( isglobal ) unset_active_nodes( p->q_forw, n );
   link_nodes( p, n );
   last_addr_ -= to - from + 1;
+  mem_stats.scratch_live -= yank_bytes;
   current_addr_ = min( from, last_addr_ );
-  modified_ = true;
+  mark_modified();
   enable_interrupts();
   return true;
   }
@@ -250,41 +328,97 @@ int get_line_node_addr( const line_t * const lp )
   int addr = 0;
 
   while( p != lp && ( p = p->q_forw ) != &buffer_head ) ++addr;
+  ++counters.addr_walks; counters.addr_steps += addr;
   if( addr && p == &buffer_head ) { invalid_address(); return -1; }
   return addr;
   }
 
 
+/* read len bytes at pos of the scratch file into buf, retrying short
+   reads; return false if error */
+static bool pread_all( char * const buf, const int len, const long pos )
+  {
+  int done = 0;
+  while( done < len )
+    {
+    const int n = pread( sfd, buf + done, len - done, pos + done );
+    if( n < 0 && errno == EINTR ) continue;
+    if( n <= 0 )
+      {
+      show_strerror( 0, n ? errno : EIO );
+      set_error_msg( "Cannot read temp file" );
+      return false;
+      }
+    done += n;
+    }
+  return true;
+  }
+
+
+/* write wbuf to the end of the scratch file */
+static bool flush_sbuf( void )
+  {
+  const long wpos = sfpos - wlen;
+  int done = 0;
+
+  disable_interrupts();		/* the SIGHUP handler reads wbuf */
+  while( done < wlen )
+    {
+    const int n = pwrite( sfd, wbuf + done, wlen - done, wpos + done );
+    if( n < 0 && errno == EINTR ) continue;
+    if( n <= 0 )
+      {
+      show_strerror( 0, n ? errno : EIO );
+      set_error_msg( "Cannot write temp file" );
+      enable_interrupts(); return false;
+      }
+    done += n;
+    }
+  wlen = 0;
+  enable_interrupts();
+  return true;
+  }
+
+
+/* Copy len bytes at pos of the written part of the scratch file to buf
+   through rbuf. Blocks are aligned to half their size, so that a line
+   of up to half a block is always inside one and reading backwards is
+   as cheap as reading forwards. */
+static bool read_sbuf( char * const buf, const int len, const long pos )
+  {
+  if( pos < rpos || pos + len > rpos + rlen )
+    {
+    const long wpos = sfpos - wlen;
+    const long start = pos - pos % ( rbuf_block / 2 );
+    if( len > rbuf_block / 2 ) return pread_all( buf, len, pos );
+    rlen = 0;
+    if( !pread_all( rbuf, min( rbuf_block, wpos - start ), start ) )
+      return false;
+    rpos = start; rlen = min( rbuf_block, wpos - start );
+    }
+  memcpy( buf, rbuf + ( pos - rpos ), len );
+  return true;
+  }
+
+
 /* get a line of text from the scratch file; return pointer to the text */
 char * get_sbuf_line( const line_t * const lp )
   {
   static char * buf = 0;
   static int bufsz = 0;
+  const long wpos = sfpos - wlen;	/* start of the text in wbuf */
   int len;
 
   if( lp == &buffer_head ) return 0;
-  seek_write = true;			/* force seek on write */
-  /* out of position */
-  if( sfpos != lp->pos )
-    {
-    sfpos = lp->pos;
-    if( fseek( sfp, sfpos, SEEK_SET ) != 0 )
-      {
-      show_strerror( 0, errno );
-      set_error_msg( "Cannot seek temp file" );
-      return 0;
-      }
-    }
+  if( lp->pos != next_read ) ++counters.sbuf_seeks;	/* out of position */
   len = lp->len;
   if( !resize_buffer( &buf, &bufsz, len + 1 ) ) return 0;
-  if( (int)fread( buf, 1, len, sfp ) != len )
-    {
-    show_strerror( 0, errno );
-    set_error_msg( "Cannot read temp file" );
-    return 0;
-    }
-  sfpos += len;		/* update file position */
+  if( lp->pos >= wpos ) memcpy( buf, wbuf + ( lp->pos - wpos ), len );
+  else if( !read_sbuf( buf, len, lp->pos ) ) return 0;
+  next_read = lp->pos + len;
   buf[len] = 0;
+  ++counters.sbuf_reads; counters.sbuf_read_bytes += len;
+  ED_PROBE2( sbuf__read, lp->pos, len );
   return buf;
   }
 
@@ -332,7 +466,7 @@ bool join_lines( const int from, const int to, const bool isglobal )
   if( !put_sbuf_line( buf, size ) ||
       !push_undo_atom( UADD, current_addr_, current_addr_ ) )
     { enable_interrupts(); return false; }
-  modified_ = true;
+  mark_modified();
   enable_interrupts();
   return true;
   }
@@ -377,7 +511,7 @@ bool move_lines( const int first_addr, const int second_addr, const int addr,
                            second_addr - first_addr + 1 : 0 );
     }
   if( isglobal ) unset_active_nodes( b2->q_forw, a2 );
-  modified_ = true;
+  mark_modified();
   enable_interrupts();
   return true;
   }
@@ -394,10 +528,80 @@ bool open_sbuf( void )
     set_error_msg( "Cannot open temp file" );
     return false;
     }
+  sfd = fileno( sfp );			/* stdio is used only to close it */
+  return true;
+  }
+
+
+/* flush the scratch file and return its descriptor for pread, or -1 */
+int sbuf_fd( void )
+  {
+  if( sfd < 0 || !flush_sbuf() ) return -1;
+  return sfd;
+  }
+
+
+/* write all of buf to fd; async-signal-safe */
+static bool write_all( const int fd, const char * const buf, const int len )
+  {
+  int done = 0;
+  while( done < len )
+    {
+    const int n = write( fd, buf + done, len - done );
+    if( n < 0 && errno == EINTR ) continue;
+    if( n <= 0 ) return false;
+    done += n;
+    }
   return true;
   }
 
 
+/* Write the buffer to fd for the SIGHUP handler, using only pread,
+   write and static buffers. The line list and wbuf are consistent here
+   because they only change with interrupts disabled. Return false if
+   error. */
+bool dump_buffer( const int fd )
+  {
+  static char in[sbuf_block], out[sbuf_block];
+  const long wpos = sfpos - wlen;
+  const line_t * const last = unterminated_line_node();
+  const line_t * lp;
+  long inpos = 0;
+  int inlen = 0, outlen = 0;
+
+  for( lp = buffer_head.q_forw; lp != &buffer_head; lp = lp->q_forw )
+    {
+    long pos = lp->pos;
+    int len = lp->len;
+    bool newline = !isbinary_ || lp != last || lp->q_forw != &buffer_head;
+    while( len > 0 || newline )
+      {
+      const char * src;
+      int n;
+      if( outlen == sbuf_block )
+        { if( !write_all( fd, out, outlen ) ) return false; outlen = 0; }
+      if( len <= 0 ) { out[outlen++] = '\n'; newline = false; continue; }
+      if( pos >= wpos ) { src = wbuf + ( pos - wpos ); n = len; }
+      else
+        {
+        if( pos < inpos || pos >= inpos + inlen )
+          {
+          inpos = pos;
+          do inlen = pread( sfd, in, min( sbuf_block, wpos - pos ), pos );
+          while( inlen < 0 && errno == EINTR );
+          if( inlen <= 0 ) return false;
+          }
+        src = in + ( pos - inpos ); n = min( len, inpos + inlen - pos );
+        }
+      n = min( n, sbuf_block - outlen );
+      memcpy( out + outlen, src, n );
+      outlen += n; pos += n; len -= n;
+      }
+    }
+  return write_all( fd, out, outlen );
+  }
+
+
 int path_max( const char * filename )
   {
   long result;
@@ -432,7 +636,7 @@ bool put_lines( const int addr )
       up = push_undo_atom( UADD, current_addr_, current_addr_ );
       if( !up ) { enable_interrupts(); return false; }
       }
-    modified_ = true;
+    mark_modified();
     lp = lp->q_forw;
     enable_interrupts();
     }
@@ -454,29 +658,34 @@ const char * put_sbuf_line( const char * const buf, const int size )
   const int len = p - buf;
   if( too_many_lines() ) return 0;
 
-  if( seek_write )				/* out of position */
+  /* assert: interrupts disabled */
+  if( len > sbuf_block - wlen && !flush_sbuf() ) return 0;
+  if( len <= sbuf_block ) { memcpy( wbuf + wlen, buf, len ); wlen += len; }
+  else
     {
-    if( fseek( sfp, 0L, SEEK_END ) != 0 )
+    int done = 0;
+    while( done < len )			/* too long for wbuf */
       {
-      show_strerror( 0, errno );
-      set_error_msg( "Cannot seek temp file" );
-      return 0;
+      const int n = pwrite( sfd, buf + done, len - done, sfpos + done );
+      if( n < 0 && errno == EINTR ) continue;
+      if( n <= 0 )
+        {
+        show_strerror( 0, n ? errno : EIO );
+        set_error_msg( "Cannot write temp file" );
+        return 0;
+        }
+      done += n;
       }
-    sfpos = ftell( sfp );
-    seek_write = false;
-    }
-  if( (int)fwrite( buf, 1, len, sfp ) != len )	/* assert: interrupts disabled */
-    {
-    sfpos = -1;
-    show_strerror( 0, errno );
-    set_error_msg( "Cannot write temp file" );
-    return 0;
     }
   line_t * lp = dup_line_node( 0 );
   if( !lp ) return 0;
   lp->pos = sfpos; lp->len = len;
   add_line_node( lp );
+  ++generation_;			/* also for lines read from files */
   sfpos += len;				/* update file position */
+  if( mem_stats.scratch_size < sfpos ) mem_stats.scratch_size = sfpos;
+  ++counters.sbuf_writes; counters.sbuf_write_bytes += len;
+  ED_PROBE2( sbuf__write, lp->pos, len );
   return p + 1;
   }
 
@@ -486,23 +695,26 @@ line_t * search_line_node( const int addr )
   {
   static line_t * lp = &buffer_head;
   static int o_addr = 0;
+  int from = o_addr;			/* where the walk starts */
 
   disable_interrupts();
+  ++counters.searches;
   if( o_addr < addr )
     {
     if( o_addr + last_addr_ >= 2 * addr )
       while( o_addr < addr ) { ++o_addr; lp = lp->q_forw; }
     else
       {
-      lp = buffer_head.q_back; o_addr = last_addr_;
+      lp = buffer_head.q_back; o_addr = from = last_addr_;
       while( o_addr > addr ) { --o_addr; lp = lp->q_back; }
       }
     }
   else if( o_addr <= 2 * addr )
     while( o_addr > addr ) { --o_addr; lp = lp->q_back; }
   else
-    { lp = &buffer_head; o_addr = 0;
+    { lp = &buffer_head; o_addr = from = 0;
       while( o_addr < addr ) { ++o_addr; lp = lp->q_forw; } }
+  counters.search_steps += ( from < o_addr ) ? o_addr - from : from - o_addr;
   enable_interrupts();
   return lp;
   }
@@ -517,12 +729,14 @@ bool yank_lines( const int from, const int to )
   line_t * p;
 
   clear_yank_buffer();
+  yank_bytes = 0;
   while( bp != ep )
     {
     disable_interrupts();
     p = dup_line_node( bp );
     if( !p ) { enable_interrupts(); return false; }
     insert_node( p, lp );
+    ++mem_stats.yank_nodes; yank_bytes += p->len;
     bp = bp->q_forw; lp = p;
     enable_interrupts();
     }
@@ -535,10 +749,44 @@ static int usize = 0;			/* ustack size (in bytes) */
 static int u_idx = 0;			/* undo stack index */
 static int u_current_addr = -1;		/* if < 0, undo disabled */
 static int u_last_addr = -1;		/* if < 0, undo disabled */
+static long u_scratch_live = 0;
 static bool u_modified = false;
+static bool u_undone = false;		/* 'u' has undone the last command */
+static time_t u_time = 0;		/* when the last command started */
+
+/* With the undo tree enabled, the undo stack of each command is kept in
+   a node instead of being freed when the next command starts. A node is
+   a child of the state the command was applied to; the nodes from the
+   root to the current state are in undo orientation and all others in
+   redo orientation, so moving between two states applies undo to the
+   nodes on the path through their common ancestor, and costs the size
+   of those changes. Deleted lines are kept until the tree is freed. */
+typedef struct unode
+  {
+  struct unode * parent;
+  undo_t * atoms;
+  int natoms;
+  int seq;				/* number of the command */
+  int depth;
+  int u_current_addr, u_last_addr;	/* the u_ state of the stack */
+  long u_scratch_live;
+  bool u_modified;
+  time_t time;
+  }
+unode_t;
 
+static bool undo_tree_ = false;
+static unode_t ** unodes = 0;		/* by seq; unodes[0] is the root */
+static int unodes_size = 0;
+static int nunodes = 0;
+static unode_t * u_cur = 0;		/* state of the buffer */
 
-void clear_undo_stack( void )
+
+void set_undo_tree( void ) { undo_tree_ = true; }
+
+
+/* free the lines deleted by the commands in the undo stack */
+static void free_undo_atoms( void )
   {
   while( u_idx-- )
     if( ustack[u_idx].type == UDEL )
@@ -551,18 +799,288 @@ void clear_undo_stack( void )
         unmark_line_node( bp );
         unmark_unterminated_line( bp );
         free( bp );
+        --mem_stats.nodes;
         bp = lp;
         }
       }
   u_idx = 0;
+  }
+
+
+/* return the root of the undo tree, creating it if needed */
+static unode_t * undo_root( void )
+  {
+  if( !unodes )
+    {
+    unode_t * const np = (unode_t *)calloc( 1, sizeof *np );
+    unodes = (unode_t **)malloc( 64 * sizeof *unodes );
+    ++counters.allocs;
+    if( !np || !unodes ) { free( np ); free( unodes ); unodes = 0; return 0; }
+    np->time = time( 0 );
+    unodes[0] = u_cur = np; unodes_size = 64; nunodes = 1;
+    mem_stats.undo_tree += sizeof *np + 64 * sizeof *unodes;
+    }
+  return unodes[0];
+  }
+
+
+/* Move the undo stack of the last command to a new node of the tree.
+   Return false if out of memory. */
+static bool archive_undo_stack( void )
+  {
+  unode_t * np;
+
+  if( !undo_root() ) return false;
+  if( nunodes >= unodes_size )
+    {
+    unode_t ** const p =
+      (unode_t **)realloc( unodes, 2 * unodes_size * sizeof *unodes );
+    ++counters.allocs;
+    if( !p ) return false;
+    mem_stats.undo_tree += unodes_size * sizeof *unodes;
+    unodes = p; unodes_size *= 2;
+    }
+  np = (unode_t *)malloc( sizeof *np );
+  ++counters.allocs;
+  if( !np ) return false;
+  np->atoms = (undo_t *)malloc( u_idx * sizeof (undo_t) );
+  if( !np->atoms ) { free( np ); return false; }
+  memcpy( np->atoms, ustack, u_idx * sizeof (undo_t) );
+  mem_stats.undo_tree += sizeof *np + u_idx * sizeof (undo_t);
+  np->natoms = u_idx;
+  np->parent = u_cur; np->depth = u_cur->depth + 1;
+  np->seq = nunodes;
+  np->u_current_addr = u_current_addr; np->u_last_addr = u_last_addr;
+  np->u_scratch_live = u_scratch_live; np->u_modified = u_modified;
+  np->time = u_time;
+  unodes[nunodes++] = np;
+  if( !u_undone ) u_cur = np;		/* else the command is a branch */
+  u_idx = 0;
+  return true;
+  }
+
+
+/* Free the nodes of the undo tree, but not the lines they refer to. */
+static void free_unodes( void )
+  {
+  int i;
+  for( i = 0; i < nunodes; ++i )
+    { free( unodes[i]->atoms ); free( unodes[i] ); }
+  free( unodes );
+  unodes = 0; unodes_size = nunodes = 0; u_cur = 0;
+  mem_stats.undo_tree = 0;
+  }
+
+
+/* Start the undo stack of a new command. With the undo tree enabled,
+   keep the one of the last command in the tree. If that runs out of
+   memory, the tree no longer matches the buffer, so it is given up,
+   leaving allocated the deleted lines it kept, and undo goes on with
+   the plain undo stack. */
+void clear_undo_stack( void )
+  {
+  if( undo_tree_ && u_idx > 0 && u_current_addr >= 0 &&
+      !archive_undo_stack() )
+    {
+    free_unodes(); undo_tree_ = false;
+    fputs( "Out of memory; undo tree disabled\n", stderr );
+    }
+  free_undo_atoms();
   u_current_addr = current_addr_;
   u_last_addr = last_addr_;
+  u_scratch_live = mem_stats.scratch_live;
   u_modified = modified_;
+  u_undone = false;
+  u_time = time( 0 );
+  }
+
+
+/* Apply undo to the stack of node np, which changes its orientation. */
+static void apply_unode( unode_t * const np )
+  {
+  undo_t * const o_ustack = ustack;
+  const int o_usize = usize;
+  const bool o_undone = u_undone;
+
+  ustack = np->atoms; usize = np->natoms * sizeof (undo_t); u_idx = np->natoms;
+  u_current_addr = np->u_current_addr; u_last_addr = np->u_last_addr;
+  u_scratch_live = np->u_scratch_live; u_modified = np->u_modified;
+  undo( false );
+  np->u_current_addr = u_current_addr; np->u_last_addr = u_last_addr;
+  np->u_scratch_live = u_scratch_live; np->u_modified = u_modified;
+  ustack = o_ustack; usize = o_usize; u_idx = 0;
+  u_undone = o_undone;
+  }
+
+
+/* Make the buffer the state after command seq (0 is the first state
+   kept). Return false if error. */
+bool goto_undo_state( int seq )
+  {
+  unode_t **path, *a, *b, *target;
+  int n, i;
+
+  if( !undo_tree_ ) { set_error_msg( "Undo tree not enabled" ); return false; }
+  if( u_current_addr < 0 ) { set_error_msg( "Nothing to undo" ); return false; }
+  clear_undo_stack();
+  if( !undo_tree_ || !undo_root() ) { set_error_msg( mem_msg ); return false; }
+  seq = max( 0, min( seq, nunodes - 1 ) );
+  target = unodes[seq];
+  a = u_cur; b = target;		/* find the common ancestor */
+  while( a->depth > b->depth ) a = a->parent;
+  while( b->depth > a->depth ) b = b->parent;
+  while( a != b ) { a = a->parent; b = b->parent; }
+  n = target->depth - a->depth;
+  path = (unode_t **)malloc( max( n, 1 ) * sizeof *path );
+  if( !path ) { set_error_msg( mem_msg ); return false; }
+  for( i = n, b = target; i > 0; b = b->parent ) path[--i] = b;
+  disable_interrupts();
+  for( b = u_cur; b != a; b = b->parent ) apply_unode( b );	/* undo */
+  for( i = 0; i < n; ++i ) apply_unode( path[i] );		/* redo */
+  u_cur = target;
+  clear_undo_stack();			/* 'u' starts from here */
+  enable_interrupts();
+  free( path );
+  return true;
+  }
+
+
+/* Return true if the undo stack holds a command not yet in the tree. */
+static bool pending_unode( void )
+  { return undo_tree_ && u_idx > 0 && u_current_addr >= 0; }
+
+
+/* seq of the current state, for relative moves; a command not yet in
+   the tree gets the next seq when it is archived */
+int undo_state( void )
+  {
+  if( pending_unode() && !u_undone ) return max( nunodes, 1 );
+  return undo_tree_ && u_cur ? u_cur->seq : 0;
+  }
+
+
+/* Return the seq of the last state kept at least secs seconds ago. */
+int undo_state_ago( const long secs )
+  {
+  const time_t t = time( 0 ) - secs;
+  int i;
+  for( i = nunodes - 1; i > 0; --i )
+    if( unodes[i]->time <= t ) return i;
+  return 0;
+  }
+
+
+/* Print the states kept, one per line: seq, seq of the parent, age,
+   and number of undo atoms, with '*' after the current one. The last
+   command, not yet in the tree, is listed as the node it will become. */
+bool print_undo_tree( void )
+  {
+  const time_t now = time( 0 );
+  const bool pending = pending_unode();
+  char buf[80];
+  int i;
+
+  if( !undo_tree_ ) { set_error_msg( "Undo tree not enabled" ); return false; }
+  if( !undo_root() ) { set_error_msg( mem_msg ); return false; }
+  for( i = 0; i < nunodes; ++i )
+    {
+    const unode_t * const np = unodes[i];
+    snprintf( buf, sizeof buf, "%6d %6d %8lds %6d%s", np->seq,
+              np->parent ? np->parent->seq : -1, (long)( now - np->time ),
+              np->natoms,
+              ( np == u_cur && ( !pending || u_undone ) ) ? " *" : "" );
+    print_message( buf );
+    }
+  if( pending )
+    {
+    snprintf( buf, sizeof buf, "%6d %6d %8lds %6d%s", nunodes, u_cur->seq,
+              (long)( now - u_time ), u_idx, u_undone ? "" : " *" );
+    print_message( buf );
+    }
+  return true;
+  }
+
+
+static int compare_pointers( const void * a, const void * b )
+  {
+  const char * const x = *(const char * const *)a;
+  const char * const y = *(const char * const *)b;
+  return ( x > y ) - ( x < y );
+  }
+
+
+/* append the lines from bp to before ep to *linesp */
+static bool collect_lines( line_t * bp, line_t * const ep, line_t *** const linesp,
+                           long * const np, long * const sizep )
+  {
+  for( ; bp != ep; bp = bp->q_forw )
+    {
+    if( *np >= *sizep )
+      {
+      line_t ** const p = (line_t **)realloc( *linesp,
+                          ( 2 * *sizep + 1024 ) * sizeof *p );
+      if( !p ) return false;
+      *linesp = p; *sizep = 2 * *sizep + 1024;
+      }
+    (*linesp)[(*np)++] = bp;
+    }
+  return true;
+  }
+
+
+/* Free the undo tree and the lines only it refers to. At the root every
+   node is in redo orientation, so the lines added by each command are
+   the detached ranges of its stack. Those and the lines at the root are
+   all the lines of the tree; the ones not in the buffer are freed. If
+   memory runs out, the lines are left allocated. */
+static void free_undo_tree( void )
+  {
+  line_t ** lines = 0;
+  long nlines = 0, size = 0;
+  bool ok = false;
+  line_t * lp;
+  int seq, i, j;
+
+  if( undo_tree_ && u_current_addr >= 0 ) clear_undo_stack();
+  seq = undo_state();
+  if( nunodes > 1 && goto_undo_state( 0 ) )
+    {
+    ok = collect_lines( buffer_head.q_forw, &buffer_head, &lines, &nlines, &size );
+    for( i = 1; ok && i < nunodes; ++i )
+      for( j = 0; ok && j < unodes[i]->natoms; ++j )
+        if( unodes[i]->atoms[j].type == UDEL )
+          ok = collect_lines( unodes[i]->atoms[j].head,
+                              unodes[i]->atoms[j].tail->q_forw,
+                              &lines, &nlines, &size );
+    goto_undo_state( seq );
+    }
+  if( ok )
+    {
+    qsort( lines, nlines, sizeof *lines, compare_pointers );
+    for( lp = buffer_head.q_forw; lp != &buffer_head; lp = lp->q_forw )
+      {
+      line_t ** const p = (line_t **)bsearch( &lp, lines, nlines,
+                                              sizeof *lines, compare_pointers );
+      if( p ) *p = 0;			/* in the buffer */
+      }
+    for( i = 0; i < nlines; ++i )
+      if( lines[i] )
+        {
+        unmark_line_node( lines[i] );
+        unmark_unterminated_line( lines[i] );
+        free( lines[i] );
+        --mem_stats.nodes;
+        }
+    }
+  free( lines );
+  free_unodes();
   }
 
 
 void reset_undo_state( void )
   {
+  free_undo_tree();
+  free_undo_atoms();
   clear_undo_stack();
   u_current_addr = u_last_addr = -1;
   u_modified = false;
@@ -577,6 +1095,7 @@ static void free_undo_stack( void )
     free( ustack );
     ustack = 0;
     usize = u_idx = 0;
+    mem_stats.undo_stack = 0;
     u_current_addr = u_last_addr = -1;
     }
   }
@@ -598,11 +1117,13 @@ undo_t * push_undo_atom( const int type, const int from, const int to )
     void * new_buf = 0;
     if( ustack ) new_buf = realloc( ustack, new_size );
     else new_buf = malloc( new_size );
+    ++counters.allocs;
     if( !new_buf )
       { show_strerror( 0, errno ); set_error_msg( mem_msg );
         free_undo_stack(); enable_interrupts(); return 0; }
     usize = new_size;
     ustack = (undo_t *)new_buf;
+    mem_stats.undo_stack = new_size;
     }
   ustack[u_idx].type = type;
   ustack[u_idx].tail = search_line_node( to );
@@ -612,6 +1133,42 @@ undo_t * push_undo_atom( const int type, const int from, const int to )
   }
 
 
+/* return the number of atoms in the undo stack */
+int undo_atoms( void ) { return u_idx; }
+
+
+/* Take back the lines from 'from' to 'to', added by a change that
+   failed, with the undo atoms pushed since 'atoms', and restore the
+   modified flag. The lines are freed, not yanked. */
+void revert_added_lines( const int from, const int to, const int atoms,
+                         const bool was_modified, const bool isglobal )
+  {
+  line_t * const n = search_line_node( inc_addr( to ) );
+  line_t * const p = search_line_node( from - 1 );	/* this last! */
+  line_t * lp = p->q_forw;
+
+  disable_interrupts();
+  if( isglobal ) unset_active_nodes( lp, n );
+  link_nodes( p, n );
+  while( lp != n )
+    {
+    line_t * const next = lp->q_forw;
+    mem_stats.scratch_live -= lp->len;
+    unmark_line_node( lp );
+    unmark_unterminated_line( lp );
+    free( lp );
+    --mem_stats.nodes;
+    lp = next;
+    }
+  last_addr_ -= to - from + 1;
+  current_addr_ = from - 1;
+  if( u_idx > atoms ) u_idx = atoms;	/* only UADD atoms since then */
+  modified_ = was_modified;
+  ++generation_;
+  enable_interrupts();
+  }
+
+
 /* undo last change to the editor buffer */
 bool undo( const bool isglobal )
   {
@@ -650,7 +1207,11 @@ bool undo( const bool isglobal )
   if( isglobal ) clear_active_list();
   current_addr_ = u_current_addr; u_current_addr = o_current_addr;
   last_addr_ = u_last_addr; u_last_addr = o_last_addr;
+  { const long tmp = mem_stats.scratch_live;
+    mem_stats.scratch_live = u_scratch_live; u_scratch_live = tmp; }
   modified_ = u_modified; u_modified = o_modified;
+  u_undone = !u_undone;
+  ++generation_;
   enable_interrupts();
   return true;
   }
@@ -40,6 +40,14 @@ typedef struct line		/* Line node */
 line_t;
 
 
+typedef struct			/* text of a line, detached from the buffer */
+  {
+  long pos;
+  int len;
+  }
+span_t;
+
+
 typedef struct
   {
   enum { UADD = 0, UDEL = 1, UMOV = 2, VMOV = 3 } type;
@@ -48,6 +56,55 @@ typedef struct
   }
 undo_t;
 
+typedef struct			/* counters updated by the core routines */
+  {
+  unsigned long long sbuf_reads;	/* lines read from the scratch file */
+  unsigned long long sbuf_read_bytes;
+  unsigned long long sbuf_writes;	/* lines written to the scratch file */
+  unsigned long long sbuf_write_bytes;
+  unsigned long long allocs;		/* calls to malloc/realloc */
+  unsigned long long sbuf_seeks;	/* seeks in the scratch file */
+  unsigned long long searches;		/* calls to search_line_node */
+  unsigned long long search_steps;	/* nodes stepped by search_line_node */
+  unsigned long long addr_walks;	/* calls to get_line_node_addr */
+  unsigned long long addr_steps;	/* nodes stepped by get_line_node_addr */
+  unsigned long long regexecs;		/* calls to regexec */
+  unsigned long long regex_misses;	/* calls to regexec finding no match */
+  unsigned long long highlights;	/* calls to highlight */
+  unsigned long long highlight_in;	/* bytes passed to highlight */
+  unsigned long long highlight_out;	/* bytes returned by highlight */
+  unsigned long long highlight_hits;	/* lines found highlighted in cache */
+  unsigned long long idle_steps;	/* steps run by idle tasks */
+  }
+counters_t;
+
+
+typedef struct			/* memory in use, kept by the allocators */
+  {
+  long nodes;			/* line nodes allocated */
+  long yank_nodes;		/* line nodes in the yank buffer */
+  long undo_stack;		/* bytes allocated for the undo stack */
+  long undo_tree;		/* bytes allocated for the undo tree */
+  long active_list;		/* bytes allocated for the global-active list */
+  long line_buffers;		/* bytes allocated by resize_buffer */
+  long highlight;		/* bytes held by the highlight layer */
+  long lexer;			/* bytes held by the token class table */
+  long scratch_size;		/* bytes written to the scratch file */
+  long scratch_live;		/* scratch bytes referenced by buffer lines */
+  }
+mem_stats_t;
+
+
+typedef struct			/* state at the start of a command */
+  {
+  long long wall;
+  long long cpu;
+  counters_t counters;
+  }
+cmd_mark_t;
+
+typedef bool (*idle_task_t)( void );	/* returns true if more to do */
+
 #ifndef max
 #define max( a, b ) ( (( a ) > ( b )) ? ( a ) : ( b ) )
 #endif
@@ -61,12 +118,17 @@ static const char * const no_prev_subst = "No previous substitution";
 /* defined in buffer.c */
 bool append_lines( const char ** const ibufpp, const int addr,
                    bool insert, const bool isglobal );
+unsigned long buffer_generation( void );
 bool close_sbuf( void );
 bool copy_lines( const int first_addr, const int second_addr, const int addr );
+bool copy_spans( const int from, const int to, span_t ** const spansp,
+                 int * const sizep );
 int current_addr( void );
 int dec_addr( int addr );
 bool delete_lines( const int from, const int to, const bool isglobal );
+bool dump_buffer( const int fd );
 int get_line_node_addr( const line_t * const lp );
+bool goto_undo_state( int seq );
 char * get_sbuf_line( const line_t * const lp );
 int inc_addr( int addr );
 int inc_current_addr( void );
@@ -79,7 +141,10 @@ bool move_lines( const int first_addr, const int second_addr, const int addr,
                  const bool isglobal );
 bool open_sbuf( void );
 int path_max( const char * filename );
+int sbuf_fd( void );
 bool put_lines( const int addr );
+bool replace_buffer( const span_t * const spans, const int n,
+                     const bool isglobal );
 const char * put_sbuf_line( const char * const buf, const int size );
 line_t * search_line_node( const int addr );
 void set_binary( void );
@@ -90,6 +155,13 @@ void clear_undo_stack( void );
 undo_t * push_undo_atom( const int type, const int from, const int to );
 void reset_undo_state( void );
 bool undo( const bool isglobal );
+int undo_atoms( void );
+void revert_added_lines( const int from, const int to, const int atoms,
+                         const bool was_modified, const bool isglobal );
+int undo_state( void );
+int undo_state_ago( const long secs );
+bool print_undo_tree( void );
+void set_undo_tree( void );
 
 /* defined in global.c */
 void clear_active_list( void );
@@ -97,21 +169,55 @@ const line_t * next_active_node( void );
 bool set_active_node( const line_t * const lp );
 void unset_active_nodes( const line_t * bp, const line_t * const ep );
 
+/* defined in autosave.c */
+void autosave( void );
+void join_autosave( void );
+void offer_recovery( const char * const filename );
+void remove_autosave( void );
+bool set_autosave( const char * const arg, const bool changes );
+
+/* defined in idle.c */
+bool add_idle_task( const idle_task_t task );
+void run_idle_tasks( void );
+
 /* defined in io.c */
+void clear_highlight_cache( void );
+bool filter_lines( const int from, const int to, const char * const command,
+                   const bool isglobal );
+bool hex_dump_lines( const int from, const int to );
 bool get_extended_line( const char ** const ibufpp, int * const lenp,
                         const bool strip_escaped_newlines );
 const char * get_stdin_line( int * const sizep );
 int linenum( void );
+bool prefetch_highlight( void );
 bool print_lines( int from, const int to, const int pflags );
+void print_message( const char * const msg );
+void print_response( const char * const status, const char * const msg,
+                     const int first_addr, const int second_addr );
 int read_file( const char * const filename, const int addr );
+int run_shell( const char * const command );
 int write_file( const char * const filename, const char * const mode,
                 const int from, const int to );
 void reset_unterminated_line( void );
+bool unterminated_last_line( void );
+const line_t * unterminated_line_node( void );
 void unmark_unterminated_line( const line_t * const lp );
 bool set_lang( const char* const s );
 
+/* defined in lexer.c */
+enum Token_class { tc_code = 1, tc_comment = 2, tc_string = 4 };
+void clear_lexer( void );
+int get_symbol_addr( const char ** const ibufpp );
+int line_token_classes( const int addr );
+int matching_bracket_addr( int addr, const bool forward );
+bool prefetch_lexer( void );
+const unsigned char * token_classes( const int addr, const char * const s,
+                                     const int len );
+bool update_lexer( void );
+
 /* defined in main.c */
 bool extended_regexp( void );
+bool json_output( void );
 bool is_regular_file( const int fd );
 bool may_access_filename( const char * const name );
 bool restricted( void );
@@ -121,6 +227,7 @@ bool strip_cr( void );
 bool traditional( void );
 
 /* defined in main_loop.c */
+const char * get_def_filename( void );
 void invalid_address( void );
 int main_loop( const bool initial_error, const bool loose );
 bool set_def_filename( const char * const s );
@@ -141,12 +248,41 @@ bool set_subst_regex( const char * const pat, const bool ignore_case );
 bool replace_subst_re_by_search_re( void );
 bool subst_regex( void );
 
+/* defined in stats.c */
+extern counters_t counters;
+extern mem_stats_t mem_stats;
+void account_command( const cmd_mark_t * const mp, const int c );
+void account_global( const cmd_mark_t * const mp );
+void mark_command_start( cmd_mark_t * const mp );
+void print_command_stats( const bool at_exit );
+void print_counters( const bool at_exit );
+void print_memory_stats( void );
+void set_counters_at_exit( void );
+void set_stats_at_exit( void );
+
+/* defined in session.c */
+bool recording( void );
+void record_line( const char * const buf, const int size );
+bool replaying( void );
+const char * replay_line( int * const sizep );
+bool session_file( const char * const name );
+bool set_record( const char * const name );
+bool set_replay( const char * const name );
+
+/* defined in snapshot.c */
+void clear_snapshots( void );
+bool diff_snapshot( const int c );
+bool restore_snapshot( const int c, const bool isglobal );
+bool save_snapshot( const int c );
+
 /* defined in signal.c */
 void disable_interrupts( void );
 void enable_interrupts( void );
+bool interrupted( void );
 bool resize_buffer( char ** const buf, int * const size, const unsigned min_size );
 void set_signals( void );
 void set_window_lines( const int lines );
 const char * strip_escapes( const char * p );
+bool take_interrupt( void );
 int window_columns( void );
 int window_lines( void );
@@ -39,6 +39,7 @@ void clear_active_list( void )
   disable_interrupts();
   if( active_list ) free( active_list );
   active_list = 0;
+  mem_stats.active_list = 0;
   active_size = active_len = active_idx = active_idxm = 0;
   enable_interrupts();
   }
@@ -67,11 +68,13 @@ bool set_active_node( const line_t * const lp )
     disable_interrupts();
     if( active_list ) new_buf = realloc( active_list, new_size );
     else new_buf = malloc( new_size );
+    ++counters.allocs;
     if( !new_buf )
       { show_strerror( 0, errno );
         set_error_msg( mem_msg ); enable_interrupts(); return false; }
     active_size = new_size;
     active_list = (const line_t **)new_buf;
+    mem_stats.active_list = new_size;
     enable_interrupts();
     }
   active_list[active_len++] = lp;
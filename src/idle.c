@@ -0,0 +1,66 @@
+/* idle.c: background work while the ed line editor waits for input. */
+/* GNU ed - The GNU line editor.
+   Copyright (C) 2022 Mathias Fuchs
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+   An idle task does one small step of work per call and returns true if
+   it has more to do. While ed waits for a line from a terminal, the tasks
+   are called in turn until all of them are done or input arrives; stdin
+   is polled before every step, so a command never waits for more than
+   one step.
+*/
+
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "ed.h"
+
+
+enum { max_idle_tasks = 8,
+       max_idle_steps = 1024 };		/* per wait, in case a task loops */
+static idle_task_t tasks[max_idle_tasks];
+static int ntasks = 0;
+static int interactive = -1;		/* stdin is a terminal */
+
+
+bool add_idle_task( const idle_task_t task )
+  {
+  if( ntasks >= max_idle_tasks ) return false;
+  tasks[ntasks++] = task;
+  return true;
+  }
+
+
+/* Run idle tasks until they are done or stdin has input. */
+void run_idle_tasks( void )
+  {
+  bool more[max_idle_tasks];
+  int busy = ntasks, steps = 0, i;
+
+  if( interactive < 0 ) interactive = isatty( 0 );
+  if( !interactive ) return;		/* scripts are never idle */
+  for( i = 0; i < ntasks; ++i ) more[i] = true;
+  while( busy > 0 && steps < max_idle_steps )
+    for( i = 0; i < ntasks; ++i )
+      if( more[i] )
+        {
+        struct pollfd pfd = { 0, POLLIN, 0 };
+        if( poll( &pfd, 1, 0 ) != 0 ) return;	/* input, or a signal */
+        if( !tasks[i]() ) { more[i] = false; --busy; }
+        ++steps; ++counters.idle_steps;
+        }
+  }
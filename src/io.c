@@ -19,11 +19,21 @@
 */
 
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include "ed.h"
+#include "probes.h"
+#ifndef ED_NO_HIGHLIGHT
 #include "sh.h"
+#endif
 
 static const line_t * unterminated_line = 0;	/* last line has no '\n' */
 static int linenum_ = 0;			/* script line number */
@@ -45,20 +55,163 @@ bool set_lang( const char* const s )
 void unmark_unterminated_line( const line_t * const lp )
   { if( unterminated_line == lp ) unterminated_line = 0; }
 
-static bool unterminated_last_line( void )
+const line_t * unterminated_line_node( void ) { return unterminated_line; }
+
+bool unterminated_last_line( void )
   { return ( unterminated_line != 0 &&
              unterminated_line == search_line_node( last_addr() ) ); }
 
 
-/* print text to stdout */
-static void print_line( const char * p, int len, const int pflags )
+/* print a string as a JSON string literal, escaping as needed */
+static void put_json_string( const char * p, int len )
+  {
+  const char escapes[] = "\b\f\n\r\t\"\\";
+  const char escchars[] = "bfnrt\"\\";
+
+  putchar('"');
+  while( --len >= 0 )
+    {
+    const unsigned char ch = *p++;
+    const char * const e = ch ? strchr( escapes, ch ) : 0;
+    if( e ) { putchar('\\'); putchar( escchars[e-escapes] ); }
+    else if( ch < 32 ) printf( "\\u%04x", ch );
+    else putchar( ch );
+    }
+  putchar('"');
+  }
+
+
+/* print an informational message (byte count, address, filename, etc) */
+void print_message( const char * const msg )
+  {
+  if( !json_output() ) { printf( "%s\n", msg ); return; }
+  fputs( "{\"type\":\"message\",\"text\":", stdout );
+  put_json_string( msg, strlen( msg ) );
+  fputs( "}\n", stdout );
+  }
+
+
+/* print the JSON record closing the output of a command */
+void print_response( const char * const status, const char * const msg,
+                     const int first_addr, const int second_addr )
+  {
+  printf( "{\"type\":\"status\",\"status\":\"%s\",\"error\":", status );
+  put_json_string( msg, strlen( msg ) );
+  printf( ",\"first\":%d,\"second\":%d,\"current\":%d,\"last\":%d}\n",
+          first_addr, second_addr, current_addr(), last_addr() );
+  }
+
+
+#ifndef ED_NO_HIGHLIGHT
+/* Highlighted lines, keyed by the position and length of their text in
+   the scratch file, which never changes while the scratch file is open. */
+enum { hl_cache_size = 256 };
+typedef struct
   {
+  long pos;
+  int len;
+  int nbytes;				/* size of text */
+  char * text;				/* highlighted text, or 0 */
+  }
+hl_entry_t;
+static hl_entry_t hl_cache[hl_cache_size];
+
+
+static hl_entry_t * hl_slot( const line_t * const lp )
+  { return &hl_cache[( lp->pos ^ ( lp->pos >> 8 ) ^ lp->len ) % hl_cache_size]; }
+
+static bool hl_cached( const line_t * const lp )
+  { const hl_entry_t * const ep = hl_slot( lp );
+    return ep->text && ep->pos == lp->pos && ep->len == lp->len; }
+
+
+/* Return the highlighted version of p, the text of line lp, and store
+   its size in *nbytesp. Use the cache if possible, else fill it. */
+static const char * highlight_line( const line_t * const lp,
+                                    const char * const p, const int len,
+                                    int * const nbytesp )
+  {
+  static char out[1000];
+  hl_entry_t * const ep = hl_slot( lp );
+  char * text;
+  int nbytes;
 
-  char out[1000];
+  if( hl_cached( lp ) )
+    { ++counters.highlight_hits; *nbytesp = ep->nbytes; return ep->text; }
+  ED_PROBE1( highlight__start, len );
+  highlight( p, len, out, &nbytes, lang );
+  ED_PROBE1( highlight__end, nbytes );
+  ++counters.highlights;
+  counters.highlight_in += len; counters.highlight_out += nbytes;
+  *nbytesp = nbytes;
+  text = (char *)realloc( ep->text, nbytes + 1 );
+  if( !text ) return out;		/* print it anyway */
+  ++counters.allocs;
+  mem_stats.highlight += nbytes + 1 - ( ep->text ? ep->nbytes + 1 : 0 );
+  memcpy( text, out, nbytes + 1 );
+  ep->pos = lp->pos; ep->len = lp->len; ep->nbytes = nbytes; ep->text = text;
+  return text;
+  }
+#endif
+
+
+void clear_highlight_cache( void )
+  {
+#ifndef ED_NO_HIGHLIGHT
+  int i;
+  for( i = 0; i < hl_cache_size; ++i )
+    if( hl_cache[i].text )
+      { free( hl_cache[i].text ); hl_cache[i].text = 0; }
+  mem_stats.highlight = 0;
+#endif
+  }
+
+
+/* Idle task: highlight the lines from the current address to one
+   window below it, which are likely to be printed next. Each line is
+   visited once per wait for input, even if it evicts another one. */
+bool prefetch_highlight( void )
+  {
+#ifndef ED_NO_HIGHLIGHT
+  static int addr = 0;			/* next line to look at */
+  static int wait = -1;			/* linenum of the wait for input */
+  const int to = min( last_addr(), current_addr() + window_lines() );
   int nbytes;
-  highlight(p, len, out, &nbytes, lang);
-  p = out;
-  len = nbytes;
+
+  if( json_output() ) return false;	/* not highlighted */
+  if( wait != linenum() ) { wait = linenum(); addr = max( current_addr(), 1 ); }
+  while( addr <= to )
+    {
+    const line_t * const lp = search_line_node( addr++ );
+    if( !hl_cached( lp ) )
+      {
+      const char * const s = get_sbuf_line( lp );
+      if( !s ) return false;
+      highlight_line( lp, s, lp->len, &nbytes );
+      return true;
+      }
+    }
+#endif
+  return false;
+  }
+
+
+/* print text of line lp to stdout */
+static void print_line( const line_t * const lp, const char * p, int len,
+                        const int pflags )
+  {
+  if( json_output() )
+    {
+    printf( "{\"type\":\"line\",\"addr\":%d,\"text\":", current_addr() );
+    put_json_string( p, len );
+    fputs( "}\n", stdout );
+    return;
+    }
+
+
+#ifndef ED_NO_HIGHLIGHT
+  p = highlight_line( lp, p, len, &len );
+#endif
 
   const char escapes[] = "\a\b\f\n\r\t\v";
   const char escchars[] = "abfnrtv";
@@ -104,16 +257,124 @@ bool print_lines( int from, const int to, const int pflags )
   if( !from ) { invalid_address(); return false; }
   while( bp != ep )
     {
+    if( interrupted() ) return false;
     const char * const s = get_sbuf_line( bp );
     if( !s ) return false;
     set_current_addr( from++ );
-    print_line( s, bp->len, pflags );
+    print_line( bp, s, bp->len, pflags );
     bp = bp->q_forw;
     }
   return true;
   }
 
 
+/* State of hex_dump_lines: the row being filled and the output. */
+static unsigned char dump_row[16];
+static int dump_n = 0;			/* bytes in dump_row */
+static long dump_offset = 0;		/* in the file, of dump_row[0] */
+static char * dump_out = 0;
+static int dump_outsz = 0;
+static int dump_len = 0;		/* bytes in dump_out */
+
+
+static void flush_dump( void )
+  {
+  fwrite( dump_out, 1, dump_len, stdout );
+  dump_len = 0;
+  }
+
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/* Append dump_offset in 8 or more hex digits to dump_out. */
+static char * put_dump_offset( char * p )
+  {
+  int i;
+  for( i = 60; i > 28 && !( dump_offset >> i ); i -= 4 ) ;
+  for( ; i >= 0; i -= 4 ) *p++ = hex_digits[( dump_offset >> i ) & 15];
+  return p;
+  }
+
+
+/* End the line of dump_out ending at p. */
+static void end_dump_line( char * p )
+  {
+  if( json_output() ) { *p = 0; print_message( dump_out ); p = dump_out; }
+  else *p++ = '\n';
+  dump_len = p - dump_out;
+  if( dump_len > dump_outsz - 128 ) flush_dump();
+  }
+
+
+/* Format dump_row as "offset  hex  hex  |ascii|", like 'hexdump -C'. */
+static void put_dump_row( void )
+  {
+  static char pairs[512];		/* two hex digits per byte value */
+  char * p = put_dump_offset( dump_out + dump_len );
+  int i;
+
+  if( !pairs[0] )
+    for( i = 0; i < 256; ++i )
+      { pairs[2*i] = hex_digits[i >> 4]; pairs[2*i+1] = hex_digits[i & 15]; }
+  *p++ = ' ';
+  for( i = 0; i < 16; ++i )
+    {
+    if( !( i & 7 ) ) *p++ = ' ';
+    if( i < dump_n ) { memcpy( p, pairs + 2 * dump_row[i], 2 ); p[2] = ' '; }
+    else memcpy( p, "   ", 3 );
+    p += 3;
+    }
+  *p++ = ' '; *p++ = '|';
+  for( i = 0; i < dump_n; ++i )
+    *p++ = ( dump_row[i] >= 32 && dump_row[i] <= 126 ) ? dump_row[i] : '.';
+  *p++ = '|';
+  end_dump_line( p );
+  dump_offset += dump_n; dump_n = 0;
+  }
+
+
+static void feed_dump( const char * p, int len )
+  {
+  while( len > 0 )
+    {
+    const int n = min( len, 16 - dump_n );
+    memcpy( dump_row + dump_n, p, n );
+    dump_n += n; p += n; len -= n;
+    if( dump_n >= 16 ) put_dump_row();
+    }
+  }
+
+
+/* Print the bytes of lines from to to, each but an unterminated last one
+   followed by a newline, as 'hexdump -C' prints them from a file. The
+   offset of line from is the sum of the lengths of the lines before it,
+   taken from the line nodes without reading any text. Rows are formatted
+   with a table of hex digit pairs into a 64 KiB buffer. */
+bool hex_dump_lines( const int from, const int to )
+  {
+  const line_t * lp = search_line_node( 1 );
+  int addr;
+
+  if( !from ) { invalid_address(); return false; }
+  if( !resize_buffer( &dump_out, &dump_outsz, 65536 ) ) return false;
+  dump_n = 0; dump_len = 0; dump_offset = 0;
+  for( addr = 1; addr < from; ++addr, lp = lp->q_forw )
+    dump_offset += lp->len + ( lp != unterminated_line );
+  for( ; addr <= to; ++addr, lp = lp->q_forw )
+    {
+    const char * const s = get_sbuf_line( lp );
+    if( interrupted() || !s ) { flush_dump(); return false; }
+    feed_dump( s, lp->len );
+    if( lp != unterminated_line ) feed_dump( "\n", 1 );
+    }
+  if( dump_n > 0 ) put_dump_row();
+  end_dump_line( put_dump_offset( dump_out + dump_len ) );
+  flush_dump();
+  set_current_addr( to );
+  return true;
+  }
+
+
 /* return the parity of escapes at the end of a string */
 static bool trailing_escape( const char * const s, int len )
   {
@@ -172,6 +433,19 @@ const char * get_stdin_line( int * const sizep )
   static int bufsz = 0;
   int i = 0;
 
+  if( !replaying() )
+    {
+    run_idle_tasks();
+    autosave();
+    if( interrupted() ) { *sizep = 0; return 0; }	/* SIGINT while idle */
+    }
+  if( replaying() )
+    {
+    const char * const s = replay_line( sizep );
+    if( s && *sizep > 0 )
+      { ++linenum_; if( memchr( s, 0, *sizep ) ) set_binary(); }
+    return s;
+    }
   while( true )
     {
     const int c = getchar();
@@ -180,6 +454,8 @@ const char * get_stdin_line( int * const sizep )
       {
       if( ferror( stdin ) )
         {
+        if( errno == EINTR && interrupted() )	/* SIGINT at the prompt */
+          { clearerr( stdin ); *sizep = 0; return 0; }
         show_strerror( "stdin", errno );
         set_error_msg( "Cannot read stdin" );
         clearerr( stdin );
@@ -190,6 +466,7 @@ const char * get_stdin_line( int * const sizep )
         set_error_msg( "Unexpected end-of-file" );
         clearerr( stdin );
         buf[0] = 0; *sizep = 0; if( i > 0 ) ++linenum_;	/* discard line */
+        if( recording() ) record_line( buf, 0 );
         return buf;
         }
       }
@@ -197,6 +474,7 @@ const char * get_stdin_line( int * const sizep )
       {
       buf[i++] = c; if( !c ) set_binary(); if( c != '\n' ) continue;
       ++linenum_; buf[i] = 0; *sizep = i;
+      if( recording() ) record_line( buf, i );
       return buf;
       }
     }
@@ -245,6 +523,14 @@ static const char * read_stream_line( const char * const filename,
   }
 
 
+static void print_size( const long size )
+  {
+  char buf[32];
+  snprintf( buf, sizeof buf, "%lu", size );
+  print_message( buf );
+  }
+
+
 /* read a stream into the editor buffer;
    return total size of data read, or -1 if error */
 static long read_stream( const char * const filename, FILE * const fp,
@@ -262,6 +548,7 @@ static long read_stream( const char * const filename, FILE * const fp,
   while( true )
     {
     int size = 0;
+    if( interrupted() ) return -1;
     const char * const s =
       read_stream_line( filename, fp, &size, &newline_added );
     if( !s ) return -1;
@@ -280,9 +567,9 @@ static long read_stream( const char * const filename, FILE * const fp,
     enable_interrupts();
     }
   if( addr && appended && total_size && o_unterminated_last_line )
-    fputs( "Newline inserted\n", stdout );		/* before stream */
+    print_message( "Newline inserted" );		/* before stream */
   else if( newline_added && ( !appended || !isbinary() ) )
-    fputs( "Newline appended\n", stdout );		/* after stream */
+    print_message( "Newline appended" );		/* after stream */
   if( !appended && isbinary() && !o_isbinary && newline_added )
     ++total_size;
   if( appended && isbinary() && ( newline_added || total_size == 0 ) )
@@ -291,6 +578,99 @@ static long read_stream( const char * const filename, FILE * const fp,
   }
 
 
+/* make a pipe whose ends are closed on exec */
+static bool make_pipe( int fds[2] )
+  {
+  if( pipe( fds ) != 0 ) return false;
+  if( fcntl( fds[0], F_SETFD, FD_CLOEXEC ) == 0 &&
+      fcntl( fds[1], F_SETFD, FD_CLOEXEC ) == 0 ) return true;
+  close( fds[0] ); close( fds[1] );
+  return false;
+  }
+
+
+/* Start '/bin/sh -c command' with posix_spawn, which does not copy the
+   address space of ed as fork does, so that its cost does not grow with
+   the buffer. If infdp, connect the stdin of the command to a pipe and
+   store its write end in *infdp; if outfdp, connect its stdout to a pipe
+   and store the read end in *outfdp. Return the pid of the shell, or -1. */
+static pid_t spawn_shell( const char * const command, int * const infdp,
+                          int * const outfdp )
+  {
+  extern char ** environ;
+  char * const argv[] = { (char *)"sh", (char *)"-c", (char *)command, 0 };
+  posix_spawn_file_actions_t actions;
+  int in[2] = { -1, -1 }, out[2] = { -1, -1 };
+  pid_t pid;
+  int err;
+
+  if( infdp && !make_pipe( in ) ) return -1;
+  if( outfdp && !make_pipe( out ) )
+    { if( infdp ) { close( in[0] ); close( in[1] ); } return -1; }
+  err = posix_spawn_file_actions_init( &actions );
+  if( !err )
+    {
+    if( infdp ) err = posix_spawn_file_actions_adddup2( &actions, in[0], 0 );
+    if( !err && outfdp )
+      err = posix_spawn_file_actions_adddup2( &actions, out[1], 1 );
+    if( !err ) err = posix_spawn( &pid, "/bin/sh", &actions, 0, argv, environ );
+    posix_spawn_file_actions_destroy( &actions );
+    }
+  if( infdp )
+    { close( in[0] ); if( err ) close( in[1] ); else *infdp = in[1]; }
+  if( outfdp )
+    { close( out[1] ); if( err ) close( out[0] ); else *outfdp = out[0]; }
+  if( err ) { errno = err; return -1; }
+  return pid;
+  }
+
+
+/* wait for a child; return its status as pclose does, or -1 */
+static int wait_child( const pid_t pid )
+  {
+  int status;
+  while( waitpid( pid, &status, 0 ) < 0 )
+    if( errno != EINTR ) return -1;
+  return status;
+  }
+
+
+/* Run a shell command as system does. A SIGINT while it runs was meant
+   for the command, not for ed. */
+int run_shell( const char * const command )
+  {
+  const pid_t pid = spawn_shell( command, 0, 0 );
+  const int status = ( pid < 0 ) ? -1 : wait_child( pid );
+  take_interrupt();
+  return status;
+  }
+
+
+/* Return a stream reading from (mode "r") or writing to (mode "w") the
+   shell command, and store the pid of the shell in *pidp. */
+static FILE * open_pipe( const char * const command, const char * const mode,
+                         pid_t * const pidp )
+  {
+  FILE * fp;
+  int fd;
+  const bool writing = ( mode[0] == 'w' );
+  *pidp = spawn_shell( command, writing ? &fd : 0, writing ? 0 : &fd );
+  if( *pidp < 0 ) return 0;
+  fp = fdopen( fd, mode );
+  if( !fp ) { close( fd ); wait_child( *pidp ); }
+  return fp;
+  }
+
+
+/* close a stream returned by open_pipe and wait for the command */
+static int close_pipe( FILE * const fp, const pid_t pid )
+  {
+  const int ret = fclose( fp );
+  const int status = wait_child( pid );
+  return ( ret != 0 ) ? -1 : status;
+  }
+
+
 /* Read a named file/pipe into the buffer.
    Return line count, -1 if file not found, -2 if fatal error.
 */
@@ -299,8 +679,10 @@ int read_file( const char * const filename, const int addr )
   FILE * fp;
   long size;
   int ret;
+  pid_t pid = -1;
 
-  if( *filename == '!' ) fp = popen( filename + 1, "r" );
+  ED_PROBE2( file__read__start, filename, addr );
+  if( *filename == '!' ) fp = open_pipe( filename + 1, "r", &pid );
   else
     {
     const char * const stripped_name = strip_escapes( filename );
@@ -314,7 +696,8 @@ int read_file( const char * const filename, const int addr )
     return -1;
     }
   size = read_stream( filename, fp, addr );
-  if( *filename == '!' ) ret = pclose( fp ); else ret = fclose( fp );
+  if( *filename == '!' ) ret = close_pipe( fp, pid ); else ret = fclose( fp );
+  ED_PROBE2( file__read__end, filename, size );
   if( size < 0 ) return -2;
   if( ret != 0 )
     {
@@ -322,7 +705,7 @@ int read_file( const char * const filename, const int addr )
     set_error_msg( "Cannot close input file" );
     return -2;
     }
-  if( !scripted() ) printf( "%lu\n", size );
+  if( !scripted() ) print_size( size );
   return current_addr() - addr;
   }
 
@@ -337,6 +720,7 @@ static long write_stream( const char * const filename, FILE * const fp,
   while( from && from <= to )
     {
     int len;
+    if( interrupted() ) return -1;
     char * p = get_sbuf_line( lp );
     if( !p ) return -1;
     len = lp->len;
@@ -363,8 +747,10 @@ int write_file( const char * const filename, const char * const mode,
   FILE * fp;
   long size;
   int ret;
+  pid_t pid = -1;
 
-  if( *filename == '!' ) fp = popen( filename + 1, "w" );
+  ED_PROBE3( file__write__start, filename, from, to );
+  if( *filename == '!' ) fp = open_pipe( filename + 1, "w", &pid );
   else
     {
     const char * const stripped_name = strip_escapes( filename );
@@ -378,7 +764,8 @@ int write_file( const char * const filename, const char * const mode,
     return -1;
     }
   size = write_stream( filename, fp, from, to );
-  if( *filename == '!' ) ret = pclose( fp ); else ret = fclose( fp );
+  if( *filename == '!' ) ret = close_pipe( fp, pid ); else ret = fclose( fp );
+  ED_PROBE2( file__write__end, filename, size );
   if( size < 0 ) return -1;
   if( ret != 0 )
     {
@@ -386,6 +773,110 @@ int write_file( const char * const filename, const char * const mode,
     set_error_msg( "Cannot close output file" );
     return -1;
     }
-  if( !scripted() ) printf( "%lu\n", size );
+  if( !scripted() ) print_size( size );
   return ( from && from <= to ) ? to - from + 1 : 0;
   }
+
+
+static span_t * spans = 0;		/* lines fed to a filter, for the thread */
+static int spans_size = 0;
+static int nspans = 0;
+static bool feed_unterminated = false;	/* no newline after the last span */
+static int feed_sfd = -1;		/* scratch file */
+static int feed_fd = -1;		/* stdin of the filter */
+
+
+/* Write the spans to the filter, 64 KiB at a time. The thread does not
+   take signals, so that a filter that does not read all of its input
+   gives EPIPE here instead of killing ed with SIGPIPE. */
+static void * feed_filter( void * arg )
+  {
+  enum { bufsz = 65536 };
+  char * const buf = (char *)malloc( bufsz );
+  int i, used = 0;
+  bool ok = ( buf != 0 );
+
+  if( arg ) {}				/* keep compiler happy */
+  for( i = 0; ok && i < nspans; ++i )
+    {
+    long pos = spans[i].pos;
+    int len = spans[i].len;
+    const bool newline = ( i < nspans - 1 || !feed_unterminated );
+    while( ok && ( len > 0 || ( newline && len == 0 ) ) )
+      {
+      if( used == bufsz )
+        { ok = ( write( feed_fd, buf, used ) == used ); used = 0; continue; }
+      if( len == 0 ) { buf[used++] = '\n'; --len; continue; }
+      const int n = pread( feed_sfd, buf + used, min( len, bufsz - used ), pos );
+      if( n <= 0 ) { ok = false; break; }
+      used += n; pos += n; len -= n;
+      }
+    }
+  if( ok && used > 0 ) ok = ( write( feed_fd, buf, used ) == used );
+  close( feed_fd );			/* end of input for the filter */
+  free( buf );
+  return 0;
+  }
+
+
+/* Replace lines from to to with the output of the shell command fed with
+   them. The lines are written by a thread while ed reads the output, so
+   neither side waits for the other to finish. If the command fails the
+   buffer is left as it was. Return false if error. */
+bool filter_lines( const int from, const int to, const char * const command,
+                   const bool isglobal )
+  {
+  pthread_t thread;
+  sigset_t set, old;
+  FILE * fp = 0;
+  long size = -1;
+  pid_t pid;
+  const line_t * const o_unterminated = unterminated_line;
+  const bool o_modified = modified();
+  const int atoms = undo_atoms();
+  int outfd, status, lines;
+  bool ok;
+
+  if( !copy_spans( from, to, &spans, &spans_size ) ) return false;
+  nspans = to - from + 1;
+  feed_unterminated = ( to == last_addr() && isbinary() &&
+                        unterminated_last_line() );
+  feed_sfd = sbuf_fd();
+  if( feed_sfd < 0 ) return false;
+  pid = spawn_shell( command, &feed_fd, &outfd );
+  if( pid < 0 )
+    {
+    show_strerror( command, errno );
+    set_error_msg( "Can't create shell process" );
+    return false;
+    }
+  sigfillset( &set );			/* signals go to the main thread */
+  pthread_sigmask( SIG_SETMASK, &set, &old );
+  ok = pthread_create( &thread, 0, feed_filter, 0 ) == 0;
+  pthread_sigmask( SIG_SETMASK, &old, 0 );
+  if( !ok )
+    {
+    close( feed_fd ); close( outfd ); wait_child( pid );
+    set_error_msg( "Can't create thread" );
+    return false;
+    }
+  fp = fdopen( outfd, "r" );
+  if( fp ) { size = read_stream( command, fp, to ); fclose( fp ); }
+  else close( outfd );
+  pthread_join( thread, 0 );
+  status = wait_child( pid );
+  lines = current_addr() - to;
+  if( size < 0 || status != 0 )		/* drop what was read */
+    {
+    if( lines > 0 )
+      revert_added_lines( to + 1, to + lines, atoms, o_modified, isglobal );
+    unterminated_line = o_unterminated;
+    set_current_addr( to );
+    if( size >= 0 ) set_error_msg( "Command failed" );
+    return false;
+    }
+  if( !delete_lines( from, to, isglobal ) ) return false;
+  if( lines > 0 ) set_current_addr( from + lines - 1 );
+  if( !scripted() ) print_size( size );
+  return true;
+  }
@@ -0,0 +1,690 @@
+/* lexer.c: C and C++ token classes for the ed line editor. */
+/* GNU ed - The GNU line editor.
+   Copyright (C) 2022 Mathias Fuchs
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+   The lexer splits each line into code, comments and string or character
+   literals by the lexical rules of C and C++ (raw strings excepted). What
+   it finds in a line depends on the text and on the state at the start
+   of the line, e.g. inside a block comment, so the result for a line is
+   kept in a hash table keyed by the position of its text in the scratch
+   file, which never changes while the file is open; moved, copied and
+   restored lines are found again. After each change of the buffer a walk
+   from the first line looks up every line with the end state of the line
+   before it and lexes only the ones not found or found with another
+   start state. It leaves per address the start state and the classes of
+   the line, so searches can skip a line without reading it.
+
+   When a line is lexed, the name it defines, if any, is found from its
+   code bytes and kept with it: a macro, a function (a line starting in
+   column 0 with a name followed by '(' and not ending in ';'), or a type
+   (after struct, class, union, enum or namespace, or the name closing a
+   typedef).
+   The walk enters the names in a hash table with their addresses, which
+   resolves '@name' in constant time. The walk runs as an idle task for
+   files named like C or C++ sources, and otherwise starts with the first
+   search for a token class or '@name'.
+
+   Each line also keeps the net change of bracket depth over its code
+   bytes and the lowest depth reached in it, relative to its start. The
+   walk sums them into the depth at the start of each line and the lowest
+   depth in each line, over which a tree of minima is built; the line of
+   a matching bracket is the first line after (or last before) a given
+   one whose lowest depth is below a level, found in O(log n).
+*/
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ed.h"
+
+
+enum Lex_state { ls_code, ls_comment, ls_line_comment, ls_string, ls_char };
+enum { step_lines = 4096 };		/* lines walked between checks */
+
+typedef struct
+  {
+  long pos;				/* -1 if empty */
+  int len;
+  unsigned char state_in, state_out;
+  unsigned char classes;		/* tc_* found in the line */
+  unsigned char mark;			/* walk_mark of the last walk seeing it */
+  int name;				/* offset in names of the name defined,
+					   or -1 */
+  int delta;				/* change of bracket depth */
+  int low;				/* lowest depth reached, <= 0 */
+  }
+lex_entry_t;
+
+typedef struct
+  {
+  int name;				/* offset in names; -1 if empty */
+  int addr;
+  }
+symbol_t;
+
+static lex_entry_t * table = 0;		/* open addressing, linear probing */
+static long table_size = 0;		/* a power of 2 */
+static long table_used = 0;
+
+static char * names = 0;		/* names defined, NUL-terminated */
+static int names_size = 0;
+static int names_len = 0;
+static symbol_t * symbols = 0;		/* open addressing, linear probing */
+static long symbols_size = 0;		/* a power of 2 */
+static long symbols_used = 0;
+
+static unsigned char * info = 0;	/* per address: classes | state << 3 */
+static int info_size = 0;
+static bool used = false;		/* a search has asked for classes */
+static bool walked = false;		/* info is up to date */
+static unsigned long walk_generation = 0;
+static int walk_addr = 0;		/* next line to look at; 0 = restart */
+static const line_t * walk_lp = 0;
+static int walk_state = ls_code;
+static int walk_depth = 0;
+static unsigned char walk_mark = 0;
+static long walk_seen = 0;		/* lines seen by the walk */
+static long walk_names = 0;		/* bytes of their names in names */
+
+static int * depths = 0;		/* bracket depth at start of each line */
+static int depths_size = 0;
+static int * tree = 0;			/* tree[leaves+addr] is the lowest depth
+					   in line addr; tree[i] the min of
+					   tree[2*i] and tree[2*i+1] */
+static int leaves = 0;			/* a power of 2 > last_addr */
+
+
+static void mark( unsigned char * const cls, const int from, const int to,
+                  const int c, int * const classesp )
+  {
+  if( cls ) memset( cls + from, c, to - from );
+  if( to > from ) *classesp |= c;
+  }
+
+
+/* Return true if the quote at s[i] is a digit separator, as in 1'000. */
+static bool digit_separator( const char * const s, int i )
+  {
+  while( i > 0 && ( isalnum( (unsigned char)s[i-1] ) || s[i-1] == '_' ||
+                    s[i-1] == '.' ) ) --i;
+  return isdigit( (unsigned char)s[i] ) != 0;
+  }
+
+
+static bool is_ident( const char c )
+  { return isalnum( (unsigned char)c ) || c == '_'; }
+
+/* Return true if the len bytes at s are the word w. */
+static bool is_word( const char * const s, const int len, const char * const w )
+  { return (int)strlen( w ) == len && !strncmp( s, w, len ); }
+
+static bool is_keyword( const char * const s, const int len )
+  {
+  static const char * const keywords[] =
+    { "if", "for", "while", "switch", "return", "sizeof", "else", "do",
+      "case", "catch", "throw", "new", "delete", "defined", "decltype",
+      "alignof", "typeof", "static_assert", "__attribute__", 0 };
+  int i;
+  for( i = 0; keywords[i]; ++i ) if( is_word( s, len, keywords[i] ) ) return true;
+  return false;
+  }
+
+
+/* Find the name defined in the len bytes of s, whose bytes have the
+   classes in cls. Store its position and length and return true if
+   found. */
+static bool find_definition( const char * const s, const int len,
+                             const unsigned char * const cls,
+                             int * const startp, int * const lenp )
+  {
+  int i = 0, j, end = len, start = -1, nlen = 0;
+  bool assign = false;
+
+  while( i < len && isspace( (unsigned char)s[i] ) ) ++i;
+  if( i < len && s[i] == '#' && cls[i] == tc_code )	/* macro */
+    {
+    for( ++i; i < len && isspace( (unsigned char)s[i] ); ++i ) ;
+    if( len - i <= 6 || strncmp( s + i, "define", 6 ) ||
+        !isspace( (unsigned char)s[i+6] ) ) return false;
+    for( i += 6; i < len && isspace( (unsigned char)s[i] ); ++i ) ;
+    for( j = i; j < len && is_ident( s[j] ); ++j ) ;
+    *startp = i; *lenp = j - i;
+    return j > i;
+    }
+  if( i > 0 || len <= 0 ) return false;	/* not in column 0 */
+  while( end > 0 && ( cls[end-1] != tc_code ||
+                      isspace( (unsigned char)s[end-1] ) ) ) --end;
+  if( end <= 0 ) return false;
+  for( i = 0; i < end && ( s[i] != '(' || cls[i] != tc_code ); ++i )
+    if( s[i] == '=' && cls[i] == tc_code ) assign = true;
+  if( i < end )					/* function */
+    {
+    if( s[end-1] == ';' || assign ) return false;	/* not a definition */
+    while( i > 0 && s[i-1] == ' ' ) --i;
+    for( j = i; j > 0 && ( is_ident( s[j-1] ) || s[j-1] == ':' ||
+                           s[j-1] == '~' ); --j ) ;
+    while( j < i && s[j] == ':' ) ++j;
+    *startp = j; *lenp = i - j;
+    return i > j && !is_keyword( s + j, i - j );
+    }
+  for( i = 0; i < end; )			/* type */
+    {
+    int w;
+    if( !is_ident( s[i] ) || cls[i] != tc_code ) { ++i; continue; }
+    for( w = i; i < end && is_ident( s[i] ); ++i ) ;
+    if( is_word( s + w, i - w, "struct" ) || is_word( s + w, i - w, "class" ) ||
+        is_word( s + w, i - w, "union" ) || is_word( s + w, i - w, "enum" ) ||
+        is_word( s + w, i - w, "namespace" ) )
+      {
+      for( j = i; j < end && isspace( (unsigned char)s[j] ); ++j ) ;
+      for( w = j; j < end && is_ident( s[j] ); ++j ) ;
+      if( j > w && !is_word( s + w, j - w, "class" ) &&
+          !is_word( s + w, j - w, "struct" ) ) { start = w; nlen = j - w; }
+      }
+    }
+  if( start >= 0 && ( s[end-1] != ';' || memchr( s, '{', end ) ) )
+    { *startp = start; *lenp = nlen; return true; }
+  if( s[end-1] != ';' ) return false;		/* typedef name */
+  for( i = end - 1; i > 0 && isspace( (unsigned char)s[i-1] ); --i ) ;
+  for( j = i; j > 0 && is_ident( s[j-1] ); --j ) ;
+  if( j >= i ) return false;
+  *startp = j; *lenp = i - j;
+  if( !strncmp( s, "typedef", 7 ) && !is_ident( s[7] ) ) return true;
+  while( j > 0 && ( isspace( (unsigned char)s[j-1] ) || s[j-1] == '}' ) ) --j;
+  return j == 0;
+  }
+
+
+/* Return the change of bracket depth over the code bytes of s and store
+   the lowest depth reached, relative to the start, in *lowp. */
+static int bracket_depth( const char * const s, const int len,
+                          const unsigned char * const cls, int * const lowp )
+  {
+  int i, depth = 0;
+  *lowp = 0;
+  for( i = 0; i < len; ++i )
+    if( cls[i] == tc_code )
+      {
+      if( s[i] == '(' || s[i] == '[' || s[i] == '{' ) ++depth;
+      else if( s[i] == ')' || s[i] == ']' || s[i] == '}' )
+        { if( --depth < *lowp ) *lowp = depth; }
+      }
+  return depth;
+  }
+
+
+/* Lex the len bytes of s from state. Store the class of each byte in cls
+   (if not 0) and that of the end of the line in cls[len], and the classes
+   found in *classesp. Return the state at the end of the line. */
+static int lex_line( const char * const s, const int len, int state,
+                     unsigned char * const cls, int * const classesp )
+  {
+  int i = 0, start;
+
+  *classesp = 0;
+  while( i < len )
+    {
+    start = i;
+    switch( state )
+      {
+      case ls_comment:
+        while( i < len && !( s[i] == '*' && i + 1 < len && s[i+1] == '/' ) ) ++i;
+        if( i < len ) { i += 2; state = ls_code; }
+        mark( cls, start, i, tc_comment, classesp );
+        break;
+      case ls_line_comment:
+        i = len;
+        mark( cls, start, i, tc_comment, classesp );
+        break;
+      case ls_string:
+      case ls_char:
+        {
+        const char quote = ( state == ls_string ) ? '"' : '\'';
+        while( i < len && s[i] != quote ) i += ( s[i] == '\\' ) ? 2 : 1;
+        if( i < len ) { ++i; state = ls_code; }
+        else if( i == len ) state = ls_code;	/* unterminated literal */
+        else i = len;				/* escaped newline */
+        mark( cls, start, i, tc_string, classesp );
+        }
+        break;
+      default:
+        while( i < len && s[i] != '"' &&
+               ( s[i] != '/' || i + 1 >= len || ( s[i+1] != '/' && s[i+1] != '*' ) ) &&
+               ( s[i] != '\'' || digit_separator( s, i ) ) ) ++i;
+        mark( cls, start, i, tc_code, classesp );
+        if( i >= len ) break;
+        if( s[i] == '/' )
+          {
+          state = ( s[i+1] == '/' ) ? ls_line_comment : ls_comment;
+          mark( cls, i, i + 2, tc_comment, classesp ); i += 2;
+          }
+        else
+          {
+          state = ( s[i] == '"' ) ? ls_string : ls_char;
+          mark( cls, i, i + 1, tc_string, classesp ); ++i;
+          }
+        break;
+      }
+    }
+  start = ( state == ls_comment || state == ls_line_comment ) ? tc_comment :
+          ( state == ls_code ) ? tc_code : tc_string;
+  if( cls ) cls[len] = start;
+  *classesp |= start;
+  if( state == ls_line_comment && ( len <= 0 || s[len-1] != '\\' ) )
+    state = ls_code;
+  return state;
+  }
+
+
+static lex_entry_t * lookup( const line_t * const lp )
+  {
+  long i = ( ( lp->pos * 2654435761UL ) ^ lp->len ) & ( table_size - 1 );
+  while( table[i].pos >= 0 &&
+         ( table[i].pos != lp->pos || table[i].len != lp->len ) )
+    i = ( i + 1 ) & ( table_size - 1 );
+  return &table[i];
+  }
+
+
+/* Make room for one more entry. Return false if out of memory. */
+static bool grow_table( void )
+  {
+  lex_entry_t * const old = table;
+  const long old_size = table_size;
+  long i;
+
+  if( table && 2 * ( table_used + 1 ) <= table_size ) return true;
+  table_size = old_size ? 2 * old_size : 4096;
+  table = (lex_entry_t *)malloc( table_size * sizeof *table );
+  ++counters.allocs;
+  if( !table )
+    { table = old; table_size = old_size; set_error_msg( mem_msg ); return false; }
+  for( i = 0; i < table_size; ++i ) table[i].pos = -1;
+  for( i = 0; i < old_size; ++i )
+    if( old[i].pos >= 0 )
+      {
+      line_t l;
+      l.pos = old[i].pos; l.len = old[i].len;
+      *lookup( &l ) = old[i];
+      }
+  free( old );
+  mem_stats.lexer += ( table_size - old_size ) * sizeof *table;
+  return true;
+  }
+
+
+/* Drop the entries not seen by the last complete walk and the names no
+   longer used. Return false if out of memory. */
+static bool sweep_table( void )
+  {
+  lex_entry_t * const old = table;
+  const long old_size = table_size;
+  char * buf = 0;
+  int bufsz = 0, buflen = 0;
+  long i;
+
+  if( !resize_buffer( &buf, &bufsz, names_len + 1 ) ) return false;
+  for( table_size = 4096; 2 * ( walk_seen + 1 ) > table_size; ) table_size *= 2;
+  table = (lex_entry_t *)malloc( table_size * sizeof *table );
+  ++counters.allocs;
+  if( !table )
+    {
+    table = old; table_size = old_size;
+    free( buf ); mem_stats.line_buffers -= bufsz;
+    set_error_msg( mem_msg ); return false;
+    }
+  for( i = 0; i < table_size; ++i ) table[i].pos = -1;
+  table_used = 0;
+  for( i = 0; i < old_size; ++i )
+    if( old[i].pos >= 0 && old[i].mark == walk_mark )
+      {
+      lex_entry_t * ep;
+      line_t l;
+      l.pos = old[i].pos; l.len = old[i].len;
+      ep = lookup( &l ); *ep = old[i]; ++table_used;
+      if( ep->name >= 0 )
+        {
+        const int n = strlen( names + ep->name ) + 1;
+        memcpy( buf + buflen, names + ep->name, n );
+        ep->name = buflen; buflen += n;
+        }
+      }
+  free( old );
+  mem_stats.lexer += ( table_size - old_size ) * sizeof *table;
+  mem_stats.line_buffers -= names_size;		/* resize_buffer */
+  free( names ); names = buf; names_size = bufsz; names_len = buflen;
+  return true;
+  }
+
+
+/* Store the name defined by the len bytes of s, lexed into cls, in
+   names, and return its offset, or -1 if none or out of memory. */
+static int store_name( const char * const s, const int len,
+                       const unsigned char * const cls )
+  {
+  int start, nlen;
+
+  if( !find_definition( s, len, cls, &start, &nlen ) ||
+      !resize_buffer( &names, &names_size, names_len + nlen + 1 ) ) return -1;
+  memcpy( names + names_len, s + start, nlen );
+  names[names_len+nlen] = 0;
+  names_len += nlen + 1;
+  return names_len - nlen - 1;
+  }
+
+
+static unsigned long hash_name( const char * s, int len )
+  {
+  unsigned long h = 2166136261UL;
+  while( --len >= 0 ) h = ( h ^ (unsigned char)*s++ ) * 16777619UL;
+  return h;
+  }
+
+
+/* Return the slot of the len bytes at s in symbols. */
+static symbol_t * find_symbol( const char * const s, const int len )
+  {
+  long i = hash_name( s, len ) & ( symbols_size - 1 );
+  while( symbols[i].name >= 0 &&
+         ( strncmp( names + symbols[i].name, s, len ) ||
+           names[symbols[i].name+len] ) )
+    i = ( i + 1 ) & ( symbols_size - 1 );
+  return &symbols[i];
+  }
+
+
+/* Enter the name at offset name with addr, unless already entered.
+   Return false if out of memory. */
+static bool add_symbol( const int name, const int addr )
+  {
+  symbol_t * sp;
+  if( 2 * ( symbols_used + 1 ) > symbols_size )
+    {
+    symbol_t * const old = symbols;
+    const long old_size = symbols_size;
+    long i;
+    symbols_size = old_size ? 2 * old_size : 1024;
+    symbols = (symbol_t *)malloc( symbols_size * sizeof *symbols );
+    ++counters.allocs;
+    if( !symbols )
+      { symbols = old; symbols_size = old_size; set_error_msg( mem_msg );
+        return false; }
+    for( i = 0; i < symbols_size; ++i ) symbols[i].name = -1;
+    for( i = 0; i < old_size; ++i )
+      if( old[i].name >= 0 )
+        *find_symbol( names + old[i].name, strlen( names + old[i].name ) ) = old[i];
+    free( old );
+    mem_stats.lexer += ( symbols_size - old_size ) * sizeof *symbols;
+    }
+  sp = find_symbol( names + name, strlen( names + name ) );
+  if( sp->name < 0 ) { sp->name = name; sp->addr = addr; ++symbols_used; }
+  return true;
+  }
+
+
+/* Forget everything; called when the scratch file is closed. */
+void clear_lexer( void )
+  {
+  free( table ); table = 0; table_size = table_used = 0;
+  free( symbols ); symbols = 0; symbols_size = symbols_used = 0;
+  mem_stats.line_buffers -= names_size + info_size;	/* resize_buffer */
+  free( names ); names = 0; names_size = names_len = 0;
+  free( info ); info = 0; info_size = 0;
+  free( depths ); depths = 0; depths_size = 0;
+  free( tree ); tree = 0; leaves = 0;
+  walked = false; walk_addr = 0; walk_seen = walk_names = 0;
+  mem_stats.lexer = 0;
+  }
+
+
+/* Size depths and tree for the buffer. Return false if out of memory. */
+static bool resize_depths( void )
+  {
+  int size = 1;
+  while( size <= last_addr() ) size *= 2;
+  if( depths_size < last_addr() + 2 || leaves != size )
+    {
+    int * const d = (int *)realloc( depths, ( last_addr() + 2 ) * sizeof *d );
+    int * t;
+    ++counters.allocs;
+    if( !d ) { set_error_msg( mem_msg ); return false; }
+    mem_stats.lexer += ( last_addr() + 2 - depths_size ) * sizeof *d;
+    depths = d; depths_size = last_addr() + 2;
+    t = (int *)realloc( tree, 2 * size * sizeof *t );
+    ++counters.allocs;
+    if( !t ) { set_error_msg( mem_msg ); return false; }
+    mem_stats.lexer += 2 * ( size - leaves ) * sizeof *t;
+    tree = t; leaves = size;
+    }
+  return true;
+  }
+
+
+/* Build the inner nodes of tree from the leaves filled by the walk. */
+static void build_tree( void )
+  {
+  int i;
+  tree[leaves] = INT_MAX;			/* address 0 */
+  for( i = leaves + last_addr() + 1; i < 2 * leaves; ++i ) tree[i] = INT_MAX;
+  for( i = leaves - 1; i >= 1; --i ) tree[i] = min( tree[2*i], tree[2*i+1] );
+  }
+
+
+/* Continue the walk over the buffer for up to n lines. Return 1 if it
+   is done, 0 if not, -1 if error. */
+static int walk_lines( int n )
+  {
+  static unsigned char * cls = 0;
+  static int clssz = 0;
+  long i;
+
+  if( walked && walk_generation == buffer_generation() ) return 1;
+  if( !walk_addr || walk_generation != buffer_generation() )
+    {
+    if( !resize_buffer( (char **)&info, &info_size, last_addr() + 1 ) ||
+        !resize_depths() ) return -1;
+    if( walked && ( table_used > 2 * walk_seen + 4096 ||
+                    names_len > 2 * walk_names + 65536 ) && !sweep_table() )
+      return -1;				/* mostly stale */
+    ++walk_mark; walk_seen = walk_names = 0;
+    walk_generation = buffer_generation();
+    walk_addr = 1; walk_state = ls_code; walk_depth = 0;
+    walk_lp = last_addr() ? search_line_node( 1 ) : 0;
+    walked = false;
+    for( i = 0; i < symbols_size; ++i ) symbols[i].name = -1;
+    symbols_used = 0;
+    }
+  for( ; walk_addr <= last_addr() && n > 0; ++walk_addr, --n )
+    {
+    lex_entry_t * ep;
+    if( !grow_table() ) return -1;
+    ep = lookup( walk_lp );
+    if( ep->pos < 0 || ep->state_in != walk_state )
+      {
+      const char * const s = get_sbuf_line( walk_lp );
+      int classes;
+      if( !s || !resize_buffer( (char **)&cls, &clssz, walk_lp->len + 1 ) )
+        return -1;
+      if( ep->pos < 0 ) ++table_used;
+      ep->pos = walk_lp->pos; ep->len = walk_lp->len;
+      ep->state_in = walk_state;
+      ep->state_out = lex_line( s, walk_lp->len, walk_state, cls, &classes );
+      ep->classes = classes;
+      ep->name = ( walk_state == ls_code ) ?
+                 store_name( s, walk_lp->len, cls ) : -1;
+      ep->delta = bracket_depth( s, walk_lp->len, cls, &ep->low );
+      }
+    ep->mark = walk_mark; ++walk_seen;
+    if( ep->name >= 0 )
+      {
+      const char * const p = strrchr( names + ep->name, ':' );
+      walk_names += strlen( names + ep->name ) + 1;
+      if( !add_symbol( ep->name, walk_addr ) ||
+          ( p && !add_symbol( p + 1 - names, walk_addr ) ) ) return -1;
+      }
+    info[walk_addr] = ep->classes | ( walk_state << 3 );
+    walk_state = ep->state_out;
+    depths[walk_addr] = walk_depth;
+    tree[leaves+walk_addr] = walk_depth + ep->low;
+    walk_depth += ep->delta;
+    walk_lp = walk_lp->q_forw;
+    }
+  if( walk_addr <= last_addr() ) return 0;
+  depths[walk_addr] = walk_depth;
+  build_tree();
+  walked = true; walk_addr = 0;
+  return 1;
+  }
+
+
+/* Bring the classes of all lines up to date, step_lines at a time so
+   that ^C can stop the walk; the next call resumes it. Return false if
+   error or interrupted. */
+bool update_lexer( void )
+  {
+  int ret;
+  used = true;
+  while( ( ret = walk_lines( step_lines ) ) == 0 )
+    if( interrupted() ) return false;
+  return ret > 0;
+  }
+
+
+/* Return the token classes in line addr, after update_lexer. */
+int line_token_classes( const int addr )
+  { return ( addr < info_size ) ? info[addr] & 7 : 0; }
+
+
+/* Return the class of each byte of s, the text of line addr, and of its
+   end in a static buffer of len + 1 bytes, after update_lexer. */
+const unsigned char * token_classes( const int addr, const char * const s,
+                                     const int len )
+  {
+  static unsigned char * buf = 0;
+  static int bufsz = 0;
+  int classes;
+
+  if( !resize_buffer( (char **)&buf, &bufsz, len + 1 ) ) return 0;
+  lex_line( s, len, ( addr < info_size ) ? info[addr] >> 3 : ls_code, buf,
+            &classes );
+  return buf;
+  }
+
+
+/* Return the address of the line defining the name after the '@' at
+   *ibufpp, and point *ibufpp past the name. Return -1 if error. */
+int get_symbol_addr( const char ** const ibufpp )
+  {
+  const char * p = ++*ibufpp;
+  const symbol_t * sp;
+
+  while( is_ident( *p ) || *p == ':' || *p == '~' ) ++p;
+  if( p == *ibufpp ) { set_error_msg( "Missing symbol name" ); return -1; }
+  if( !update_lexer() ) return -1;
+  sp = symbols ? find_symbol( *ibufpp, p - *ibufpp ) : 0;
+  if( !sp || sp->name < 0 ) { set_error_msg( "Undefined symbol" ); return -1; }
+  *ibufpp = p;
+  return sp->addr;
+  }
+
+
+/* Return the first line after addr whose lowest depth is below level,
+   or 0 if none. */
+static int first_below( const int addr, const int level )
+  {
+  int i = leaves + addr + 1;
+  if( addr + 1 >= leaves ) return 0;
+  while( tree[i] >= level )
+    {
+    while( i > 1 && ( i & 1 ) ) i >>= 1;	/* up while a right child */
+    if( i == 1 ) return 0;
+    ++i;				/* right sibling */
+    }
+  while( i < leaves ) { i *= 2; if( tree[i] >= level ) ++i; }
+  return i - leaves;
+  }
+
+
+/* Return the last line before addr whose lowest depth is below level,
+   or 0 if none. */
+static int last_below( const int addr, const int level )
+  {
+  int i = leaves + addr - 1;
+  if( addr <= 1 ) return 0;
+  while( tree[i] >= level )
+    {
+    while( i > 1 && !( i & 1 ) ) i >>= 1;	/* up while a left child */
+    if( i == 1 ) return 0;
+    --i;				/* left sibling */
+    }
+  while( i < leaves ) { i = 2 * i + 1; if( tree[i] >= level ) --i; }
+  return i - leaves;
+  }
+
+
+/* Return true if line addr ends deeper than the lowest depth in it, i.e.,
+   it leaves an opening bracket unmatched. */
+static bool leaves_open( const int addr )
+  { return depths[addr+1] > tree[leaves+addr]; }
+
+
+/* If forward, return the line of the bracket matching the last opening
+   bracket left open by line addr, or by the next line if addr leaves none
+   open (as in a function header followed by '{'), else the line closing
+   the block around the end of line addr. If not forward, return the line
+   of the bracket matching the first unmatched closing bracket in line
+   addr, else the line opening the block around its start. Return -1 if
+   error. */
+int matching_bracket_addr( int addr, const bool forward )
+  {
+  int low, match;
+
+  if( addr < 1 || addr > last_addr() )
+    { invalid_address(); return -1; }
+  if( !update_lexer() ) return -1;
+  if( last_addr() + 2 > depths_size || last_addr() >= leaves )
+    { set_error_msg( "internal error: bracket index too small" ); return -1; }
+  if( forward && !leaves_open( addr ) && addr < last_addr() &&
+      leaves_open( addr + 1 ) ) ++addr;
+  low = tree[leaves+addr] - depths[addr];
+  match = forward ? first_below( addr, depths[addr+1] ) :
+          last_below( addr, depths[addr] + low - ( low == 0 ) + 1 );
+  if( !match ) { set_error_msg( "No matching bracket" ); return -1; }
+  return match;
+  }
+
+
+/* Return true if the default filename looks like C or C++ source. */
+static bool c_source( void )
+  {
+  static const char * const suffixes[] =
+    { ".c", ".h", ".cc", ".cpp", ".cxx", ".hh", ".hpp", ".hxx", ".C", ".H", 0 };
+  const char * const p = strrchr( get_def_filename(), '.' );
+  int i;
+  if( p ) for( i = 0; suffixes[i]; ++i ) if( !strcmp( p, suffixes[i] ) ) return true;
+  return false;
+  }
+
+
+/* Idle task: keep the classes and names up to date for C and C++ files,
+   or once they have been used. */
+bool prefetch_lexer( void )
+  {
+  return ( used || c_source() ) && walk_lines( step_lines ) == 0;
+  }
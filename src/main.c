@@ -32,6 +32,7 @@
  *
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -46,6 +47,7 @@ static const char * const program_year = "2022";
 static const char * invocation_name = "ed";		/* default value */
 
 static bool extended_regexp_ = false;	/* if set, use EREs */
+static bool json_ = false;		/* if set, print JSON records */
 static bool restricted_ = false;	/* if set, run in restricted mode */
 static bool scripted_ = false;		/* if set, suppress diagnostics,
 					   byte counts and '!' prompt */
@@ -54,6 +56,7 @@ static bool traditional_ = false;	/* if set, be backwards compatible */
 
 /* Access functions for command line flags. */
 bool extended_regexp( void ) { return extended_regexp_; }
+bool json_output( void ) { return json_; }
 bool restricted( void ) { return restricted_; }
 bool scripted( void ) { return scripted_; }
 bool strip_cr( void ) { return strip_cr_; }
@@ -81,7 +84,14 @@ static void show_help( void )
           "  -r, --restricted           run in restricted mode\n"
           "  -s, --quiet, --silent      suppress diagnostics, byte counts and '!' prompt\n"
           "  -v, --verbose              be verbose; equivalent to the 'H' command\n"
+          "      --autosave=SECS        save a modified buffer every SECS seconds\n"
+          "      --autosave-changes=N   also save it after N changes\n"
+          "      --json                 print one JSON record per output line and command\n"
+          "      --record=FILE          log the lines read from stdin to FILE\n"
+          "      --replay=FILE          read the lines from FILE and time each command\n"
+          "      --stats                print the cost of each command to stderr at exit\n"
           "      --strip-trailing-cr    strip carriage returns at end of text lines\n"
+          "      --undo-tree            keep every state of the buffer for 'U'\n"
           "\nStart edit by reading in 'file' if given.\n"
           "If 'file' begins with a '!', read output of shell command.\n"
           "\nExit status: 0 for a normal exit, 1 for environmental problems (file\n"
@@ -152,7 +162,9 @@ int main( const int argc, const char * const argv[] )
   int argind;
   bool initial_error = false;		/* fatal error reading file */
   bool loose = false;
-  enum { opt_cr = 256 };
+  const char * filename = 0;		/* file given to ed */
+  enum { opt_cr = 256, opt_autosave, opt_autosave_changes, opt_json, opt_record, opt_replay, opt_stats,
+         opt_undo_tree };
   const struct ap_Option options[] =
     {
     { 'E', "extended-regexp",      ap_no  },
@@ -167,6 +179,13 @@ int main( const int argc, const char * const argv[] )
     { 'v', "verbose",              ap_no  },
     { 'V', "version",              ap_no  },
     { opt_cr, "strip-trailing-cr", ap_no  },
+    { opt_autosave, "autosave",    ap_yes },
+    { opt_autosave_changes, "autosave-changes", ap_yes },
+    { opt_json, "json",            ap_no  },
+    { opt_record, "record",        ap_yes },
+    { opt_replay, "replay",        ap_yes },
+    { opt_stats, "stats",          ap_no  },
+    { opt_undo_tree, "undo-tree",  ap_no  },
     {  0, 0,                       ap_no } };
 
   struct Arg_parser parser;
@@ -195,18 +214,33 @@ int main( const int argc, const char * const argv[] )
       case 'v': set_verbose(); break;
       case 'V': show_version(); return 0;
       case opt_cr: strip_cr_ = true; break;
+      case opt_autosave:
+      case opt_autosave_changes:
+        if( set_autosave( arg, code == opt_autosave_changes ) ) break;
+        show_error( "Bad autosave value", 0, true ); return 1;
+      case opt_json: json_ = true; break;
+      case opt_record: if( set_record( arg ) ) break;
+                       show_error( "Cannot open record file", errno, false );
+                       return 1;
+      case opt_replay: if( set_replay( arg ) ) break;
+                       show_error( "Cannot open replay file", errno, false );
+                       return 1;
+      case opt_stats: set_stats_at_exit(); break;
+      case opt_undo_tree: set_undo_tree(); break;
       default : show_error( "internal error: uncaught option.", 0, false );
                 return 3;
       }
     } /* end process options */
 
   setlocale( LC_ALL, "" );
+  if( getenv( "ED_COUNTERS" ) ) set_counters_at_exit();
   if( !init_buffers() ) return 1;
 
   while( argind < ap_arguments( &parser ) )
     {
     const char * const arg = ap_argument( &parser, argind );
     if( strcmp( arg, "-" ) == 0 ) { scripted_ = true; ++argind; continue; }
+    filename = arg;
     if( may_access_filename( arg ) )
       {
       const int ret = read_file( arg, 0 );
@@ -221,8 +255,12 @@ int main( const int argc, const char * const argv[] )
       }
     break;
     }
+  if( !session_file( filename ) )
+    { show_error( "Bad replay file", errno, false ); return 1; }
+  if( !scripted_ )
+    offer_recovery( ( filename && filename[0] != '!' ) ? filename : 0 );
   ap_free( &parser );
 
-  if( initial_error ) fputs( "?\n", stdout );
+  if( initial_error && !json_ ) fputs( "?\n", stdout );
   return main_loop( initial_error, loose );
   }
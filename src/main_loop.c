@@ -19,12 +19,12 @@
 #include <ctype.h>
 #include <errno.h>
 #include <limits.h>
-#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "ed.h"
+#include "probes.h"
 
 
 enum Status { QUIT = -1, ERR = -2, EMOD = -3, FATAL = -4 };
@@ -43,6 +43,8 @@ static bool verbose = false;		/* if set, print all error messages */
 
 void invalid_address( void ) { set_error_msg( "Invalid address" ); }
 
+const char * get_def_filename( void ) { return def_filename; }
+
 bool set_def_filename( const char * const s )
   {
   static char * buf = 0;		/* filename buffer */
@@ -154,7 +156,7 @@ static const char * get_shell_command( const char ** const ibufpp )
   if( !resize_buffer( &shcmd, &shcmdsz, i + 1 ) ) return 0;
   memcpy( shcmd, buf, i );
   shcmd[i] = 0; shcmdlen = i;
-  if( replacement ) { printf( "%s\n", shcmd + 1 ); fflush( stdout ); }
+  if( replacement ) { print_message( shcmd + 1 ); fflush( stdout ); }
   return shcmd;
   }
 
@@ -271,6 +273,16 @@ static int extract_addresses( const char ** const ibufpp )
                 second_addr = get_marked_node_addr( *(*ibufpp)++ );
                 if( second_addr < 0 ) return -1;
                 break;
+      case '[':
+      case ']': ++*ibufpp;
+                n = matching_bracket_addr( first ? current_addr() : second_addr,
+                                           ch == ']' );
+                if( n < 0 ) return -1;
+                first = false; second_addr = n; break;
+      case '@': if( !first ) { invalid_address(); return -1; }
+                second_addr = get_symbol_addr( ibufpp );
+                if( second_addr < 0 ) return -1;
+                first = false; break;
       case '%':
       case ',':
       case ';': if( first )
@@ -484,9 +496,10 @@ static bool command_s( const char ** const ibufpp, int * const pflagsp,
 static int exec_global( const char ** const ibufpp, const int pflags,
                         const bool interactive );
 
-/* execute the next command in command buffer; return error status */
-static int exec_command( const char ** const ibufpp, const int prev_status,
-                         const bool isglobal )
+/* execute the next command in command buffer; return error status.
+   Store the command character in *cp. */
+static int run_command( const char ** const ibufpp, const int prev_status,
+                        const bool isglobal, int * const cp )
   {
   const char * fnp;				/* filename */
   int pflags = 0;				/* print suffixes */
@@ -495,7 +508,8 @@ static int exec_command( const char ** const ibufpp, const int prev_status,
 
   if( addr_cnt < 0 ) return ERR;
   *ibufpp = skip_blanks( *ibufpp );
-  c = *(*ibufpp)++;
+  c = *cp = (unsigned char)*(*ibufpp)++;
+  ED_PROBE3( command__start, c, first_addr, second_addr );
   switch( c )
     {
     case 'a': if( !get_command_suffix( ibufpp, &pflags ) ) return ERR;
@@ -503,6 +517,11 @@ static int exec_command( const char ** const ibufpp, const int prev_status,
               if( !append_lines( ibufpp, second_addr, false, isglobal ) )
                 return ERR;
               break;
+    case 'B': n = *(*ibufpp)++;
+              if( unexpected_address( addr_cnt ) ||
+                  !get_command_suffix( ibufpp, &pflags ) ||
+                  !save_snapshot( n ) ) return ERR;
+              break;
     case 'c': if( !check_addr_range2( addr_cnt ) ||
                   !get_command_suffix( ibufpp, &pflags ) ) return ERR;
               if( !isglobal ) clear_undo_stack();
@@ -511,6 +530,11 @@ static int exec_command( const char ** const ibufpp, const int prev_status,
                                  current_addr() >= first_addr, isglobal ) )
                 return ERR;
               break;
+    case 'D': n = *(*ibufpp)++;
+              if( unexpected_address( addr_cnt ) ||
+                  !get_command_suffix( ibufpp, &pflags ) ||
+                  !diff_snapshot( n ) ) return ERR;
+              break;
     case 'd': if( !check_addr_range2( addr_cnt ) ||
                   !get_command_suffix( ibufpp, &pflags ) ) return ERR;
               if( !isglobal ) clear_undo_stack();
@@ -540,7 +564,7 @@ static int exec_command( const char ** const ibufpp, const int prev_status,
               {
               const char * const stripped_name = strip_escapes( def_filename );
               if( !stripped_name ) return ERR;
-              printf( "%s\n", stripped_name );
+              print_message( stripped_name );
               }
               break;
     case 'g':
@@ -561,7 +585,7 @@ static int exec_command( const char ** const ibufpp, const int prev_status,
                   !get_command_suffix( ibufpp, &pflags ) ) return ERR;
               if( c == 'H' ) verbose = !verbose;
               if( ( c == 'h' || verbose ) && errmsg[0] )
-                printf( "%s\n", errmsg );
+                print_message( errmsg );
               break;
     case 'i': if( !get_command_suffix( ibufpp, &pflags ) ) return ERR;
               if( !isglobal ) clear_undo_stack();
@@ -618,9 +642,23 @@ pflabel:      if( !check_addr_range2( addr_cnt ) ||
               if( addr < 0 ) return ERR;
               if( addr ) set_modified( true );
               break;
+    case 'R': n = *(*ibufpp)++;
+              if( unexpected_address( addr_cnt ) ||
+                  !get_command_suffix( ibufpp, &pflags ) ) return ERR;
+              if( !isglobal ) clear_undo_stack();
+              if( !restore_snapshot( n, isglobal ) ) return ERR;
+              break;
     case 's': if( !command_s( ibufpp, &pflags, addr_cnt, isglobal ) )
                 return ERR;
               break;
+    case 'S': n = **ibufpp;
+              if( n == 'c' || n == 'm' ) ++*ibufpp;
+              if( unexpected_address( addr_cnt ) ||
+                  !get_command_suffix( ibufpp, &pflags ) ) return ERR;
+              if( n == 'c' ) print_counters( false );
+              else if( n == 'm' ) print_memory_stats();
+              else print_command_stats( false );
+              break;
     case 't': if( !check_addr_range2( addr_cnt ) ||
                   !get_third_addr( ibufpp, &addr ) ||
                   !get_command_suffix( ibufpp, &pflags ) ) return ERR;
@@ -631,6 +669,20 @@ pflabel:      if( !check_addr_range2( addr_cnt ) ||
                   !get_command_suffix( ibufpp, &pflags ) ||
                   !undo( isglobal ) ) return ERR;
               break;
+    case 'U': n = **ibufpp;
+              if( unexpected_address( addr_cnt ) ) return ERR;
+              if( isglobal )
+                { set_error_msg( "Cannot use 'U' in a global command" );
+                  return ERR; }
+              if( n == '\n' ) { if( !print_undo_tree() ) return ERR; break; }
+              if( n == '@' || n == '-' || n == '+' ) ++*ibufpp;
+              if( !parse_int( &addr, *ibufpp, ibufpp ) ||
+                  !get_command_suffix( ibufpp, &pflags ) ) return ERR;
+              if( n == '@' ) addr = undo_state_ago( addr );
+              else if( n == '-' ) addr = undo_state() - addr;
+              else if( n == '+' ) addr = undo_state() + addr;
+              if( !goto_undo_state( addr ) ) return ERR;
+              break;
     case 'w':
     case 'W': n = **ibufpp;
               if( n == 'q' || n == 'Q' ) ++*ibufpp;
@@ -651,6 +703,11 @@ pflabel:      if( !check_addr_range2( addr_cnt ) ||
                 return EMOD;
               if( n == 'q' || n == 'Q' ) return QUIT;
               break;
+    case 'X': if( !check_addr_range2( addr_cnt ) ||
+                  !get_command_suffix( ibufpp, &pflags ) ||
+                  !hex_dump_lines( first_addr, second_addr ) ) return ERR;
+              pflags = 0;
+              break;
     case 'x': if( second_addr < 0 || second_addr > last_addr() )
                 { invalid_address(); return ERR; }
               if( !get_command_suffix( ibufpp, &pflags ) ) return ERR;
@@ -673,14 +730,25 @@ pflabel:      if( !check_addr_range2( addr_cnt ) ||
               pflags = 0;
               break;
     case '=': if( !get_command_suffix( ibufpp, &pflags ) ) return ERR;
-              printf( "%d\n", addr_cnt ? second_addr : last_addr() );
+              {
+              char buf[16];
+              snprintf( buf, sizeof buf, "%d", addr_cnt ? second_addr : last_addr() );
+              print_message( buf );
+              }
+              break;
+    case '|': if( !check_addr_range2( addr_cnt ) ) return ERR;
+              fnp = get_shell_command( ibufpp );
+              if( !fnp ) return ERR;
+              if( !isglobal ) clear_undo_stack();
+              if( !filter_lines( first_addr, second_addr, fnp + 1, isglobal ) )
+                return ERR;
               break;
     case '!': if( unexpected_address( addr_cnt ) ) return ERR;
               fnp = get_shell_command( ibufpp );
               if( !fnp ) return ERR;
-              if( system( fnp + 1 ) < 0 )
+              if( run_shell( fnp + 1 ) < 0 )
                 { set_error_msg( "Can't create shell process" ); return ERR; }
-              if( !scripted() ) fputs( "!\n", stdout );
+              if( !scripted() ) print_message( "!" );
               break;
     case '\n': if( !check_second_addr( current_addr() +
                      ( traditional() || !isglobal ), addr_cnt ) ||
@@ -696,10 +764,25 @@ pflabel:      if( !check_addr_range2( addr_cnt ) ||
   }
 
 
+/* execute the next command in command buffer, accounting its cost */
+static int exec_command( const char ** const ibufpp, const int prev_status,
+                         const bool isglobal )
+  {
+  cmd_mark_t mark;
+  int c = 0;
+
+  mark_command_start( &mark );
+  const int status = run_command( ibufpp, prev_status, isglobal, &c );
+  ED_PROBE2( command__end, c, status );
+  account_command( &mark, c );
+  return status;
+  }
+
+
 /* Apply command list in the command buffer to the active lines in a range.
    Stop at first error. Return status of last command executed. */
-static int exec_global( const char ** const ibufpp, const int pflags,
-                        const bool interactive )
+static int run_global( const char ** const ibufpp, const int pflags,
+                       const bool interactive )
   {
   static char * buf = 0;
   static int bufsz = 0;
@@ -720,6 +803,7 @@ static int exec_global( const char ** const ibufpp, const int pflags,
     {
     const line_t * const lp = next_active_node();
     if( !lp ) break;
+    if( interrupted() ) return ERR;
     set_current_addr( get_line_node_addr( lp ) );
     if( current_addr() < 0 ) return ERR;
     if( interactive )
@@ -752,32 +836,71 @@ static int exec_global( const char ** const ibufpp, const int pflags,
   }
 
 
+static int exec_global( const char ** const ibufpp, const int pflags,
+                        const bool interactive )
+  {
+  cmd_mark_t mark;
+
+  mark_command_start( &mark );
+  const int status = run_global( ibufpp, pflags, interactive );
+  account_global( &mark );
+  return status;
+  }
+
+
 static void script_error( void )
   {
   if( verbose ) fprintf( stderr, "script, line %d: %s\n", linenum(), errmsg );
   }
 
 
+/* Tell the user (or the program driving us) how a command ended.
+   In JSON mode every command gets a status record, otherwise only
+   errors are reported with a '?'. */
+static void report_status( const int status, const char * const prefix )
+  {
+  if( json_output() )
+    print_response( ( status == 0 ) ? "ok" : ( status == QUIT ) ? "quit" :
+                    "error", ( status == 0 || status == QUIT ) ? "" : errmsg,
+                    first_addr, second_addr );
+  else if( status != 0 && status != QUIT ) { fputs( prefix, stdout );
+                                             fputs( "?\n", stdout ); }
+  }
+
+
+/* If SIGINT has arrived during the last command or read, report it
+   and return true. The command may have been stopped between two lines,
+   but the buffer and the undo stack are consistent. */
+static bool report_interrupt( void )
+  {
+  if( !take_interrupt() ) return false;
+  set_error_msg( "Interrupt" );
+  report_status( ERR, "\n" );
+  return true;
+  }
+
+
 int main_loop( const bool initial_error, const bool loose )
   {
-  extern jmp_buf jmp_state;
   const char * ibufp;			/* pointer to command buffer */
-  volatile int err_status = 0;		/* program exit status */
-  int len = 0, status;
+  int err_status = 0;			/* program exit status */
+  int len = 0, status = 0;
 
-  disable_interrupts();
   set_signals();
-  status = setjmp( jmp_state );
-  if( status == 0 )			/* direct invocation of setjmp */
-    { enable_interrupts(); if( initial_error ) { status = -1; err_status = 1; } }
-  else { status = -1; fputs( "\n?\n", stdout ); set_error_msg( "Interrupt" ); }
+  add_idle_task( prefetch_highlight );
+  add_idle_task( prefetch_lexer );
+  if( initial_error ) { status = -1; err_status = 1;
+    if( json_output() ) report_status( ERR, "" ); }
 
   while( true )
     {
     fflush( stdout ); fflush( stderr );
-    if( status < 0 && verbose ) { printf( "%s\n", errmsg ); fflush( stdout ); }
-    if( prompt_on ) { fputs( prompt_str, stdout ); fflush( stdout ); }
+    if( status < 0 && verbose && !json_output() )
+      { printf( "%s\n", errmsg ); fflush( stdout ); }
+    if( prompt_on && !json_output() )
+      { fputs( prompt_str, stdout ); fflush( stdout ); }
     ibufp = get_stdin_line( &len );
+    if( report_interrupt() ) { status = -1; continue; }
     if( !ibufp ) return 2;			/* an error happened */
     if( len <= 0 )				/* EOF on stdin ('q') */
       {
@@ -785,14 +908,17 @@ int main_loop( const bool initial_error, const bool loose )
       else { status = EMOD; if( !loose ) err_status = 2; }
       }
     else status = exec_command( &ibufp, status, false );
+    if( status != QUIT && status != FATAL && report_interrupt() )
+      { status = -1; continue; }		/* 'q' ends ed even if interrupted */
+    if( status == EMOD ) set_error_msg( "Warning: buffer modified" );
+    report_status( status, "" );		/* give warning */
     if( status == 0 ) continue;
     if( status == QUIT ) return err_status;
-    fputs( "?\n", stdout );			/* give warning */
     if( !loose && err_status == 0 ) err_status = 1;
-    if( status == EMOD ) set_error_msg( "Warning: buffer modified" );
     if( is_regular_file( 0 ) )
       { script_error(); return ( ( status == FATAL ) ? 1 : err_status ); }
     if( status == FATAL )
-      { if( verbose ) { printf( "%s\n", errmsg ); } return 1; }
+      { if( verbose && !json_output() ) { printf( "%s\n", errmsg ); }
+        return 1; }
     }
   }
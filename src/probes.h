@@ -0,0 +1,54 @@
+/* Static tracepoints for the ed editor.  */
+/* GNU ed - The GNU line editor.
+   Copyright (C) 2022 Mathias Fuchs
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+   USDT probes of provider 'ed', usable with perf, bpftrace, systemtap,
+   etc, e.g.  bpftrace -e 'usdt:./ed:ed:command__end { @[arg0] = count(); }'
+   A probe is a nop in the instruction stream until a tracer attaches.
+   If <sys/sdt.h> is not available, or ED_NO_PROBES is defined, the probes
+   compile to nothing.
+
+   command__start   (command char, first address, second address)
+   command__end     (command char, status)
+   sbuf__read       (scratch position, length)
+   sbuf__write      (scratch position, length)
+   regex__start     (text)
+   regex__end       (regexec return value)
+   highlight__start (input length)
+   highlight__end   (output length)
+   file__read__start  (filename, address)
+   file__read__end    (filename, bytes read or -1)
+   file__write__start (filename, first address, second address)
+   file__write__end   (filename, bytes written or -1)
+*/
+
+#if !defined ED_NO_PROBES && defined __has_include
+#if __has_include( <sys/sdt.h> )
+#include <sys/sdt.h>
+#define ED_PROBES 1
+#endif
+#endif
+
+#ifdef ED_PROBES
+#define ED_PROBE1( name, a1 ) DTRACE_PROBE1( ed, name, a1 )
+#define ED_PROBE2( name, a1, a2 ) DTRACE_PROBE2( ed, name, a1, a2 )
+#define ED_PROBE3( name, a1, a2, a3 ) DTRACE_PROBE3( ed, name, a1, a2, a3 )
+#else
+#define ED_PROBE1( name, a1 ) do {} while( 0 )
+#define ED_PROBE2( name, a1, a2 ) do {} while( 0 )
+#define ED_PROBE3( name, a1, a2, a3 ) do {} while( 0 )
+#endif
@@ -25,15 +25,19 @@
 #include <string.h>
 
 #include "ed.h"
+#include "probes.h"
 
 
 static const char * const inv_i_suf   = "Suffix 'I' not allowed on empty regexp";
+static const char * const inv_m_suf   = "Suffix 'M' not allowed on empty regexp";
 static const char * const inv_pat_del = "Invalid pattern delimiter";
 static const char * const mis_pat_del = "Missing pattern delimiter";
 static const char * const no_match    = "No match";
 static const char * const no_prev_pat = "No previous pattern";
 static regex_t * last_regexp = 0;	/* pointer to last regex found */
 static regex_t * subst_regexp = 0;	/* regex of last substitution */
+static int last_span = 1;		/* lines a match of last_regexp spans */
+static int search_classes = 0;		/* token classes to search; 0 = all */
 
 static char * rbuf = 0;			/* replacement buffer */
 static int rbufsz = 0;			/* replacement buffer size */
@@ -63,6 +67,20 @@ static void nul_to_newline( char * const s, const int len )
   { translit_text( s, len, '\0', '\n' ); }
 
 
+/* regexec with accounting */
+static int match_regex( const regex_t * const exp, const char * const s,
+                        const size_t nmatch, regmatch_t * const rm,
+                        const int eflags )
+  {
+  ED_PROBE1( regex__start, s );
+  const int ret = regexec( exp, s, nmatch, rm, eflags );
+  ED_PROBE1( regex__end, ret );
+  ++counters.regexecs;
+  if( ret ) ++counters.regex_misses;
+  return ret;
+  }
+
+
 /* expand a POSIX character class */
 static const char * parse_char_class( const char * p )
   {
@@ -110,19 +128,54 @@ static char * extract_pattern( const char ** const ibufpp, const char delimiter
   }
 
 
+/* Return in a static buffer a copy of pat with each '\n' outside of
+   brackets replaced by a newline. Set *spanp to the number of lines a
+   match may span, i.e., 1 plus the number of newlines. */
+static const char * multiline_pattern( const char * pat, int * const spanp )
+  {
+  static char * buf = 0;
+  static int bufsz = 0;
+  int i = 0;
+
+  *spanp = 1;
+  if( !resize_buffer( &buf, &bufsz, strlen( pat ) + 1 ) ) return 0;
+  while( *pat )
+    {
+    if( *pat == '[' )
+      {
+      const char * const nd = parse_char_class( pat + 1 );
+      const int len = nd ? nd + 1 - pat : (int)strlen( pat );
+      memcpy( buf + i, pat, len ); i += len; pat += len;
+      }
+    else if( *pat == '\\' && pat[1] == 'n' )
+      { buf[i++] = '\n'; pat += 2; ++*spanp; }
+    else if( *pat == '\\' && pat[1] )
+      { buf[i++] = *pat++; buf[i++] = *pat++; }
+    else buf[i++] = *pat++;
+    }
+  buf[i] = 0;
+  return buf;
+  }
+
+
 /* Return pointer to compiled regex (last_regexp), different from subst_regexp.
-   Return 0 if error.
+   If multiline, '\n' matches a newline and '^', '$', '.' and '[^...]' work
+   per line. Return 0 if error.
 */
-static regex_t * compile_regex( const char * const pat, const bool ignore_case )
+static regex_t * compile_regex( const char * pat, const bool ignore_case,
+                                const bool multiline )
   {
+  int span = 1;
   static regex_t store[3];		/* space for three compiled regexes */
   regex_t * exp;
   int n;
 
   for( n = 0; n < 3; ++n )
     if( ( exp = &store[n] ) != last_regexp && exp != subst_regexp ) break;
+  if( multiline && !( pat = multiline_pattern( pat, &span ) ) ) return 0;
   const int cflags = ( extended_regexp() ? REG_EXTENDED : 0 ) |
-                     ( ignore_case ? REG_ICASE : 0 );
+                     ( ignore_case ? REG_ICASE : 0 ) |
+                     ( multiline ? REG_NEWLINE : 0 );
   n = regcomp( exp, pat, cflags );
   if( n )
     {
@@ -134,12 +187,31 @@ static regex_t * compile_regex( const char * const pat, const bool ignore_case )
   /* free last_regexp if compiled and different from subst_regexp */
   if( last_regexp && last_regexp != subst_regexp ) regfree( last_regexp );
   last_regexp = exp;
+  last_span = span;
   return last_regexp;
   }
 
 
+/* Return the token class selected by suffix c, or 0 if c is not one. */
+static int class_suffix( const char c )
+  { return ( c == 'C' ) ? tc_code : ( c == 'K' ) ? tc_comment :
+           ( c == 'L' ) ? tc_string : 0; }
+
+
+/* Read the suffixes of token classes into search_classes. */
+static void get_class_suffixes( const char ** const ibufpp )
+  {
+  int c;
+  search_classes = 0;
+  while( ( c = class_suffix( **ibufpp ) ) && !( search_classes & c ) )
+    { search_classes |= c; ++*ibufpp; }
+  }
+
+
 /* return pointer to compiled regex from command buffer, or to previous
-   compiled regex if empty RE. return 0 if error */
+   compiled regex if empty RE. The suffixes 'C', 'K' and 'L' restrict the
+   search to matches starting in code, comments or literals.
+   return 0 if error */
 static regex_t * get_compiled_regex( const char ** const ibufpp )
   {
   const char delimiter = **ibufpp;
@@ -151,16 +223,26 @@ static regex_t * get_compiled_regex( const char ** const ibufpp )
     if( !last_regexp ) { set_error_msg( no_prev_pat ); return 0; }
     if( **ibufpp == delimiter && *++*ibufpp == 'I' )	/* remove delimiter */
       { set_error_msg( inv_i_suf ); return 0; }
+    if( **ibufpp == 'M' ) { set_error_msg( inv_m_suf ); return 0; }
+    get_class_suffixes( ibufpp );
     return last_regexp;
     }
   else
     {
     const char * const pat = extract_pattern( ibufpp, delimiter );
     if( !pat ) return 0;
-    bool ignore_case = false;
-    if( **ibufpp == delimiter && *++*ibufpp == 'I' )	/* remove delimiter */
-      { ignore_case = true; ++*ibufpp; }		/* remove suffix */
-    return compile_regex( pat, ignore_case );
+    bool ignore_case = false, multiline = false;
+    search_classes = 0;
+    if( **ibufpp == delimiter )
+      for( ++*ibufpp; ; ++*ibufpp )	/* remove delimiter and suffixes */
+        {
+        const int c = class_suffix( **ibufpp );
+        if( **ibufpp == 'I' && !ignore_case ) ignore_case = true;
+        else if( **ibufpp == 'M' && !multiline ) multiline = true;
+        else if( c && !( search_classes & c ) ) search_classes |= c;
+        else break;
+        }
+    return compile_regex( pat, ignore_case, multiline );
     }
   }
 
@@ -192,7 +274,7 @@ bool set_subst_regex( const char * const pat, const bool ignore_case )
   if( !*pat && ignore_case ) { set_error_msg( inv_i_suf ); return false; }
 
   disable_interrupts();
-  regex_t * exp = *pat ? compile_regex( pat, ignore_case ) : last_regexp;
+  regex_t * exp = *pat ? compile_regex( pat, ignore_case, false ) : last_regexp;
   if( exp && exp != subst_regexp )
     {
     if( subst_regexp ) regfree( subst_regexp );
@@ -218,6 +300,104 @@ bool replace_subst_re_by_search_re( void )
   }
 
 
+/* Window of consecutive lines for patterns spanning more than one line.
+   It holds the text of up to last_span lines from wfirst, joined by
+   newlines, and slides forward one line at a time, so a search reads
+   each line once and never holds more than last_span lines. */
+static char * wbuf = 0;
+static int wbufsz = 0;
+static int wlen = 0;			/* bytes in wbuf */
+static int * wlens = 0;			/* length of each line in wbuf */
+static int wlens_size = 0;
+static int wlines = 0;			/* lines in wbuf */
+static int wfirst = 0;			/* address of first line; 0 = none */
+static const line_t * wnext = 0;	/* line after the window */
+
+
+/* Return 0 if a match of exp in s starts at or before limit, in a byte
+   of one of search_classes if cls, 1 if not. */
+static int match_classes( const regex_t * const exp, const char * const s,
+                          const int limit, const unsigned char * const cls )
+  {
+  regmatch_t rm;
+  int off = 0;
+  while( off <= limit &&
+         !match_regex( exp, s + off, 1, &rm, off ? REG_NOTBOL : 0 ) )
+    {
+    const int start = off + rm.rm_so;
+    if( start > limit ) break;
+    if( !cls || ( cls[start] & search_classes ) ) return 0;
+    off = start + 1;
+    }
+  return 1;
+  }
+
+
+/* Return 0 if a match of exp starts in line addr, pointed to by lp,
+   1 if not, -1 if error. */
+static int match_window( const regex_t * const exp, const int addr,
+                         const line_t * const lp )
+  {
+  regmatch_t rm;
+  int i, n;
+
+  if( wlens_size < last_span )
+    {
+    int * const p = (int *)realloc( wlens, last_span * sizeof *p );
+    if( !p ) { set_error_msg( mem_msg ); return -1; }
+    wlens = p; wlens_size = last_span; wfirst = 0;
+    }
+  if( wfirst > 0 && addr == wfirst + 1 && wlines > 0 )	/* slide */
+    {
+    n = min( wlens[0] + 1, wlen );
+    wlen -= n; memmove( wbuf, wbuf + n, wlen );
+    for( i = 1; i < wlines; ++i ) wlens[i-1] = wlens[i];
+    --wlines;
+    }
+  else { wlen = 0; wlines = 0; wnext = lp; }
+  wfirst = addr;
+  while( wlines < last_span && addr + wlines <= last_addr() )
+    {
+    const char * const s = get_sbuf_line( wnext );
+    if( !s ) return -1;
+    n = wnext->len;
+    if( !resize_buffer( &wbuf, &wbufsz, wlen + n + 2 ) ) return -1;
+    if( wlines > 0 ) wbuf[wlen++] = '\n';
+    memcpy( wbuf + wlen, s, n );
+    if( isbinary() ) nul_to_newline( wbuf + wlen, n );
+    wlen += n;
+    wlens[wlines++] = n;
+    wnext = wnext->q_forw;
+    }
+  wbuf[wlen] = 0;
+  if( search_classes )
+    {
+    const unsigned char * const cls = token_classes( addr, wbuf, wlens[0] );
+    return cls ? match_classes( exp, wbuf, wlens[0], cls ) : -1;
+    }
+  return ( !match_regex( exp, wbuf, 1, &rm, 0 ) && rm.rm_so <= wlens[0] ) ? 0 : 1;
+  }
+
+
+/* Return 0 if a match of exp starts in line lp, 1 if not, -1 if error.
+   Lines without any of search_classes are skipped unread. */
+static int match_line( const regex_t * const exp, const int addr,
+                       const line_t * const lp )
+  {
+  const unsigned char * cls;
+  char * s;
+  if( search_classes && !( line_token_classes( addr ) & search_classes ) )
+    return 1;
+  if( last_span > 1 ) return match_window( exp, addr, lp );
+  s = get_sbuf_line( lp );
+  if( !s ) return -1;
+  if( isbinary() ) nul_to_newline( s, lp->len );
+  if( !search_classes ) return match_regex( exp, s, 0, 0, 0 ) ? 1 : 0;
+  cls = token_classes( addr, s, lp->len );
+  return cls ? match_classes( exp, s, lp->len, cls ) : -1;
+  }
+
+
 /* add lines matching a regular expression to the global-active list */
 bool build_active_list( const char ** const ibufpp, const int first_addr,
                         const int second_addr, const bool match )
@@ -225,16 +405,16 @@ bool build_active_list( const char ** const ibufpp, const int first_addr,
   int addr;
 
   const regex_t * const exp = get_compiled_regex( ibufpp );
-  if( !exp ) return false;
+  if( !exp || ( search_classes && !update_lexer() ) ) return false;
   clear_active_list();
+  wfirst = 0;
   const line_t * lp = search_line_node( first_addr );
   for( addr = first_addr; addr <= second_addr; ++addr, lp = lp->q_forw )
     {
-    char * const s = get_sbuf_line( lp );
-    if( !s ) return false;
-    if( isbinary() ) nul_to_newline( s, lp->len );
-    if( match == !regexec( exp, s, 0, 0, 0 ) && !set_active_node( lp ) )
-      return false;
+    if( interrupted() ) return false;
+    const int ret = match_line( exp, addr, lp );
+    if( ret < 0 ) return false;
+    if( match == !ret && !set_active_node( lp ) ) return false;
     }
   return true;
   }
@@ -248,16 +428,16 @@ int next_matching_node_addr( const char ** const ibufpp )
   const regex_t * const exp = get_compiled_regex( ibufpp );
   int addr = current_addr();
 
-  if( !exp ) return -1;
+  if( !exp || ( search_classes && !update_lexer() ) ) return -1;
+  wfirst = 0;
   do {
     addr = ( forward ? inc_addr( addr ) : dec_addr( addr ) );
+    if( interrupted() ) return -1;
     if( addr )
       {
-      const line_t * const lp = search_line_node( addr );
-      char * const s = get_sbuf_line( lp );
-      if( !s ) return -1;
-      if( isbinary() ) nul_to_newline( s, lp->len );
-      if( !regexec( exp, s, 0, 0, 0 ) ) return addr;
+      const int ret = match_line( exp, addr, search_line_node( addr ) );
+      if( ret < 0 ) return -1;
+      if( !ret ) return addr;
       }
     }
   while( addr != current_addr() );
@@ -363,7 +543,7 @@ static int line_replace( char ** txtbufp, int * const txtbufszp,
   if( !txt ) return -1;
   if( isbinary() ) nul_to_newline( txt, lp->len );
   eot = txt + lp->len;
-  if( !regexec( subst_regexp, txt, se_max, rm, 0 ) )
+  if( !match_regex( subst_regexp, txt, se_max, rm, 0 ) )
     {
     int matchno = 0;
     bool infloop = false;
@@ -391,7 +571,7 @@ static int line_replace( char ** txtbufp, int * const txtbufszp,
           else { set_error_msg( "Infinite substitution loop" ); return -1; } }
       }
     while( *txt && ( !changed || global ) &&
-           !regexec( subst_regexp, txt, se_max, rm, REG_NOTBOL ) );
+           !match_regex( subst_regexp, txt, se_max, rm, REG_NOTBOL ) );
     i = eot - txt;
     if( !resize_buffer( txtbufp, txtbufszp, offset + i + 2 ) ) return -1;
     if( isbinary() ) newline_to_nul( txt, i );
@@ -415,6 +595,7 @@ bool search_and_replace( const int first_addr, const int second_addr,
 
   for( lc = 0; lc <= second_addr - first_addr; ++lc, ++addr )
     {
+    if( interrupted() ) return false;
     const line_t * const lp = search_line_node( addr );
     const int size = line_replace( &txtbuf, &txtbufsz, lp, snum );
     if( size < 0 ) return false;
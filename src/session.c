@@ -0,0 +1,200 @@
+/* session.c: command session record and replay for the ed line editor. */
+/* GNU ed - The GNU line editor.
+   Copyright (C) 2022 Mathias Fuchs
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+   A session log is a text header followed by one record per line read
+   from stdin:
+
+     ed-session 1
+     F size mtime name          the file given to ed ('-1 0' and no name
+                                if none); checked when replaying
+     L at busy len              a line of 'len' bytes follows, read 'at'
+       <len bytes>              microseconds after the start; the previous
+                                line kept ed busy for 'busy' microseconds
+     E at busy                  end of input (ed may go on reading, e.g.,
+                                after a warning about unsaved changes)
+
+   'busy' is the time from reading a line to starting to read the next
+   one, i.e., the time spent executing the command without the time the
+   user took to type the next one.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "ed.h"
+
+
+static const char magic[] = "ed-session 1\n";
+static FILE * record_fp = 0;		/* log being written */
+static FILE * replay_fp = 0;		/* log being replayed */
+static long long start_time;		/* of the session, in microseconds */
+static long long read_time = -1;	/* when the last line was read */
+static const char * last_line = 0;	/* last line replayed, for the report */
+static int last_line_size = 0;
+static int replay_linenum = 0;
+
+
+static long long clock_us( void )
+  {
+  struct timespec ts;
+  if( clock_gettime( CLOCK_MONOTONIC, &ts ) != 0 ) return 0;
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+  }
+
+/* microseconds spent since the last line was read, or 0 */
+static long long busy_time( const long long now )
+  { return ( read_time >= 0 ) ? now - read_time : 0; }
+
+
+bool recording( void ) { return record_fp != 0; }
+bool replaying( void ) { return replay_fp != 0; }
+
+
+bool set_record( const char * const name )
+  {
+  record_fp = fopen( name, "w" );
+  if( !record_fp ) return false;
+  fputs( magic, record_fp );
+  start_time = clock_us();
+  return true;
+  }
+
+
+bool set_replay( const char * const name )
+  {
+  char buf[sizeof magic];
+  replay_fp = fopen( name, "r" );
+  if( !replay_fp ) return false;
+  if( !fgets( buf, sizeof buf, replay_fp ) || strcmp( buf, magic ) != 0 )
+    { fclose( replay_fp ); replay_fp = 0; errno = EINVAL; return false; }
+  fputs( "line,recorded_us,replay_us,command\n", stderr );
+  return true;
+  }
+
+
+/* Write the identity of the file given to ed to the log being recorded,
+   or compare it with the one in the log being replayed. */
+bool session_file( const char * const name )
+  {
+  struct stat st;
+  const bool found = name && name[0] != '!' && stat( name, &st ) == 0;
+  const long long size = found ? (long long)st.st_size : -1;
+  const long long mtime = found ? (long long)st.st_mtime : 0;
+
+  if( record_fp )
+    {
+    fprintf( record_fp, "F %lld %lld %s\n", size, mtime, name ? name : "" );
+    fflush( record_fp );
+    }
+  if( replay_fp )
+    {
+    char rname[1024] = "";
+    long long rsize, rmtime;
+    if( fscanf( replay_fp, "F %lld %lld", &rsize, &rmtime ) != 2 ||
+        getc( replay_fp ) != ' ' ||
+        !fgets( rname, sizeof rname, replay_fp ) )
+      { errno = EINVAL; return false; }
+    rname[strcspn( rname, "\n" )] = 0;
+    if( strcmp( rname, name ? name : "" ) != 0 )
+      fprintf( stderr, "replay: recorded with file '%s', not '%s'\n",
+               rname, name ? name : "" );
+    else if( rsize != size || rmtime != mtime )
+      fprintf( stderr, "replay: file '%s' has changed since recording\n", rname );
+    }
+  return true;
+  }
+
+
+/* Append a line read from stdin to the log being recorded, or mark the
+   end of input if size is 0. */
+void record_line( const char * const buf, const int size )
+  {
+  const long long now = clock_us();
+  if( size > 0 )
+    {
+    fprintf( record_fp, "L %lld %lld %d\n", now - start_time, busy_time( now ),
+             size );
+    fwrite( buf, 1, size, record_fp );
+    read_time = now;
+    }
+  else
+    {
+    fprintf( record_fp, "E %lld %lld\n", now - start_time, busy_time( now ) );
+    read_time = -1;
+    }
+  fflush( record_fp );			/* keep the log if ed is killed */
+  }
+
+
+/* Print the recorded and replayed busy times of the last line replayed. */
+static void report_line( const long long now, const long long recorded_busy )
+  {
+  int i;
+  if( !last_line ) return;
+  fprintf( stderr, "%d,%lld,%lld,\"", replay_linenum, recorded_busy,
+           busy_time( now ) );
+  for( i = 0; i < last_line_size && last_line[i] != '\n'; ++i )
+    {
+    if( last_line[i] == '"' ) putc( '"', stderr );
+    putc( last_line[i], stderr );
+    }
+  fputs( "\"\n", stderr );
+  }
+
+
+/* Return the next line of the log being replayed, as get_stdin_line
+   does, and report the time the previous one took. */
+const char * replay_line( int * const sizep )
+  {
+  static char * buf = 0;
+  static int bufsz = 0;
+  const long long now = clock_us();
+  long long at, busy;
+  const int c = getc( replay_fp );
+  int size = 0;
+
+  if( c == 'L' && fscanf( replay_fp, " %lld %lld %d", &at, &busy, &size ) == 3 &&
+      getc( replay_fp ) == '\n' && size > 0 )
+    {
+    report_line( now, busy );
+    last_line = 0;
+    if( !resize_buffer( &buf, &bufsz, size + 1 ) ) { *sizep = 0; return 0; }
+    if( (int)fread( buf, 1, size, replay_fp ) == size )
+      {
+      buf[size] = 0;
+      last_line = buf; last_line_size = size;
+      ++replay_linenum; read_time = clock_us();
+      *sizep = size;
+      return buf;
+      }
+    }
+  if( c == 'E' && fscanf( replay_fp, " %lld %lld", &at, &busy ) == 2 &&
+      getc( replay_fp ) == '\n' )
+    report_line( now, busy );
+  else if( c != EOF )
+    fprintf( stderr, "replay: bad record after line %d\n", replay_linenum );
+  last_line = 0; read_time = -1;
+  set_error_msg( "Unexpected end-of-file" );
+  if( !buf && !resize_buffer( &buf, &bufsz, 1 ) ) { *sizep = 0; return 0; }
+  buf[0] = 0; *sizep = 0;
+  return buf;
+  }
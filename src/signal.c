@@ -19,8 +19,8 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
-#include <setjmp.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,49 +31,86 @@
 #include "ed.h"
 
 
-jmp_buf jmp_state;			/* jumps to main_loop */
-static int mutex = 0;			/* if > 0, signals stay pending */
+static int mutex = 0;			/* if > 0, SIGHUP stays pending */
 static int window_lines_ = 22;		/* scroll lines set by sigwinch_handler */
 static int window_columns_ = 72;
-static bool sighup_pending = false;
-static bool sigint_pending = false;
+static volatile sig_atomic_t sighup_pending = 0;
+static volatile sig_atomic_t sigint_pending = 0;
+static bool interrupt_taken = false;	/* an operation gave up on SIGINT */
+static const char hb[] = "ed.hup";
+static char * home_hup = 0;		/* $HOME/ed.hup, set by set_signals */
 
 
+/* Save a modified buffer to ed.hup, or to $HOME/ed.hup if that fails,
+   and exit. Only async-signal-safe calls are used, on file names and
+   buffers prepared in advance, so that the save neither deadlocks nor
+   allocates; it costs one write per 64 KiB. */
 static void sighup_handler( int signum )
   {
+  const char * const names[2] = { hb, home_hup };
+  int i;
+
   if( signum ) {}			/* keep compiler happy */
-  if( mutex ) { sighup_pending = true; return; }
-  sighup_pending = false;
-  const char hb[] = "ed.hup";
-  if( last_addr() <= 0 || !modified() ||
-      write_file( hb, "w", 1, last_addr() ) >= 0 ) exit( 0 );
-  char * const s = getenv( "HOME" );
-  if( !s || !s[0] ) exit( 1 );
+  if( mutex ) { sighup_pending = 1; return; }
+  sighup_pending = 0;
+  if( last_addr() <= 0 || !modified() ) _exit( 0 );
+  for( i = 0; i < 2; ++i )
+    {
+    const int fd = names[i] ?
+      open( names[i], O_WRONLY | O_CREAT | O_TRUNC, 0666 ) : -1;
+    if( fd < 0 ) continue;
+    const bool ok = dump_buffer( fd );
+    if( close( fd ) == 0 && ok ) _exit( 0 );
+    }
+  _exit( 1 );				/* hup file write failed */
+  }
+
+
+/* prepare the name of the second hup file */
+static void set_home_hup( void )
+  {
+  const char * const s = getenv( "HOME" );
+  if( !s || !s[0] ) return;
   const int len = strlen( s );
   const int need_slash = s[len-1] != '/';
-  char * const hup = ( len + need_slash + (int)sizeof hb < path_max( 0 ) ) ?
-                     (char *)malloc( len + need_slash + sizeof hb ) : 0;
-  if( !hup ) exit( 1 );			/* hup file name */
-  memcpy( hup, s, len );
-  if( need_slash ) hup[len] = '/';
-  memcpy( hup + len + need_slash, hb, sizeof hb );
-  if( write_file( hup, "w", 1, last_addr() ) >= 0 ) exit( 0 );
-  exit( 1 );				/* hup file write failed */
+  if( len + need_slash + (int)sizeof hb >= path_max( 0 ) ) return;
+  home_hup = (char *)malloc( len + need_slash + sizeof hb );
+  if( !home_hup ) return;
+  memcpy( home_hup, s, len );
+  if( need_slash ) home_hup[len] = '/';
+  memcpy( home_hup + len + need_slash, hb, sizeof hb );
   }
 
 
+/* Only note the interrupt; the operation in progress sees it at the next
+   call to interrupted() and gives up, leaving the buffer consistent. */
 static void sigint_handler( int signum )
   {
-  if( mutex ) sigint_pending = true;
-  else
-    {
-    sigset_t set;
-    sigint_pending = false;
-    sigemptyset( &set );
-    sigaddset( &set, signum );
-    sigprocmask( SIG_UNBLOCK, &set, 0 );
-    longjmp( jmp_state, -1 );
-    }
+  if( signum ) {}			/* keep compiler happy */
+  sigint_pending = 1;
+  }
+
+
+/* Return true if SIGINT has arrived since the last call. Long operations
+   call this between lines and, if true, stop with error "Interrupt". */
+bool interrupted( void )
+  {
+  if( !sigint_pending ) return false;
+  sigint_pending = 0;
+  interrupt_taken = true;
+  set_error_msg( "Interrupt" );
+  return true;
+  }
+
+
+/* Return true if SIGINT has arrived since the last call, whether or not
+   an operation has stopped because of it. Called by main_loop after each
+   command. */
+bool take_interrupt( void )
+  {
+  const bool ret = interrupt_taken || sigint_pending;
+  interrupt_taken = false; sigint_pending = 0;
+  return ret;
   }
 
 
@@ -99,8 +136,8 @@ static int set_signal( const int signum, void (*handler)( int ) )
 
   new_action.sa_handler = handler;
   sigemptyset( &new_action.sa_mask );
-#ifdef SA_RESTART
-  new_action.sa_flags = SA_RESTART;
+#ifdef SA_RESTART			/* SIGINT must stop a read at the prompt */
+  new_action.sa_flags = ( signum == SIGINT ) ? 0 : SA_RESTART;
 #else
   new_action.sa_flags = 0;
 #endif
@@ -114,7 +151,6 @@ void enable_interrupts( void )
     {
     mutex = 0;
     if( sighup_pending ) sighup_handler( SIGHUP );
-    if( sigint_pending ) sigint_handler( SIGINT );
     }
   }
 
@@ -128,6 +164,7 @@ void set_signals( void )
   sigwinch_handler( SIGWINCH );
   if( isatty( 0 ) ) set_signal( SIGWINCH, sigwinch_handler );
 #endif
+  set_home_hup();
   set_signal( SIGHUP, sighup_handler );
   set_signal( SIGQUIT, SIG_IGN );
   set_signal( SIGINT, sigint_handler );
@@ -152,9 +189,11 @@ bool resize_buffer( char ** const buf, int * const size, const unsigned min_size
     disable_interrupts();
     if( *buf ) new_buf = realloc( *buf, new_size );
     else new_buf = malloc( new_size );
+    ++counters.allocs;
     if( !new_buf )
       { show_strerror( 0, errno );
         set_error_msg( mem_msg ); enable_interrupts(); return false; }
+    mem_stats.line_buffers += new_size - *size;
     *size = new_size;
     *buf = (char *)new_buf;
     enable_interrupts();
@@ -0,0 +1,217 @@
+/* snapshot.c: named buffer snapshots for the ed line editor. */
+/* GNU ed - The GNU line editor.
+   Copyright (C) 2022 Mathias Fuchs
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+   Text in the scratch file is never changed, so a snapshot of the buffer
+   is just the (pos, len) of each line: 12 to 16 bytes per line and no
+   text. 'Bx' takes snapshot x, 'Rx' makes it the buffer again and 'Dx'
+   prints the changes from it to the buffer in the format of diff(1).
+   Lines are compared by position, not text: unchanged, moved and copied
+   lines keep theirs, so the comparison is exact and reads nothing, but a
+   line rewritten with the same text counts as changed. Snapshots refer
+   to the scratch file and are dropped when it is closed.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ed.h"
+
+
+typedef struct
+  {
+  span_t * spans;		/* 0 if not taken */
+  int size;			/* spans allocated */
+  int lines;
+  }
+snapshot_t;
+
+static snapshot_t snapshots[26];
+
+
+static snapshot_t * get_snapshot( const int c, const bool taken )
+  {
+  snapshot_t * sp;
+  if( c < 'a' || c > 'z' )
+    { set_error_msg( "Invalid snapshot name" ); return 0; }
+  sp = &snapshots[c-'a'];
+  if( taken && !sp->spans ) { set_error_msg( "No such snapshot" ); return 0; }
+  return sp;
+  }
+
+
+/* drop all snapshots; called when the scratch file is closed */
+void clear_snapshots( void )
+  {
+  int i;
+  for( i = 0; i < 26; ++i )
+    {
+    free( snapshots[i].spans );
+    snapshots[i].spans = 0; snapshots[i].size = 0; snapshots[i].lines = 0;
+    }
+  }
+
+
+bool save_snapshot( const int c )
+  {
+  snapshot_t * const sp = get_snapshot( c, false );
+  if( !sp || !copy_spans( 1, last_addr(), &sp->spans, &sp->size ) )
+    return false;
+  sp->lines = last_addr();
+  return true;
+  }
+
+
+bool restore_snapshot( const int c, const bool isglobal )
+  {
+  const snapshot_t * const sp = get_snapshot( c, true );
+  return sp && replace_buffer( sp->spans, sp->lines, isglobal );
+  }
+
+
+static bool same_line( const span_t * const a, const span_t * const b )
+  { return a->pos == b->pos && a->len == b->len; }
+
+
+/* Mark in del and ins the lines of a not in b and of b not in a, with
+   the O(ND) algorithm of Myers. Return false if more than max_d lines
+   differ, leaving del and ins all set. */
+static bool diff_spans( const span_t * const a, const int n,
+                        const span_t * const b, const int m,
+                        char * const del, char * const ins )
+  {
+  enum { max_d = 2048 };
+  const int limit = min( n + m, max_d );
+  int * const v = (int *)malloc( ( 2 * limit + 3 ) * sizeof *v );
+  int ** const trace = (int **)calloc( limit + 1, sizeof *trace );
+  int d, k, x, y, found = -1;
+
+  memset( del, 1, n ); memset( ins, 1, m );
+  if( !v || !trace ) { free( v ); free( trace ); return false; }
+  v[limit+2] = 0;			/* v[k] is v[limit+1+k] */
+  for( d = 0; d <= limit && found < 0; ++d )
+    {
+    for( k = -d; k <= d; k += 2 )
+      {
+      int * const vk = v + limit + 1 + k;
+      x = ( k == -d || ( k != d && vk[-1] < vk[1] ) ) ? vk[1] : vk[-1] + 1;
+      y = x - k;
+      while( x < n && y < m && same_line( a + x, b + y ) ) { ++x; ++y; }
+      *vk = x;
+      if( x >= n && y >= m ) found = d;
+      }
+    trace[d] = (int *)malloc( ( 2 * d + 1 ) * sizeof (int) );
+    if( !trace[d] ) break;
+    memcpy( trace[d], v + limit + 1 - d, ( 2 * d + 1 ) * sizeof (int) );
+    }
+  if( found >= 0 && trace[found] )
+    {
+    x = n; y = m;
+    for( d = found; d > 0; --d )
+      {
+      const int * const vp = trace[d-1] + d - 1;	/* vp[k] for d - 1 */
+      int pk, px, py;
+      k = x - y;
+      pk = ( k == -d || ( k != d && vp[k-1] < vp[k+1] ) ) ? k + 1 : k - 1;
+      px = vp[pk]; py = px - pk;
+      while( x > px && y > py ) { --x; --y; del[x] = ins[y] = 0; }
+      if( pk == k + 1 ) y = py; else x = px;	/* insertion or deletion */
+      }
+    while( x > 0 && y > 0 ) { --x; --y; del[x] = ins[y] = 0; }
+    }
+  for( d = 0; d <= limit; ++d ) free( trace[d] );
+  free( trace ); free( v );
+  return found >= 0;
+  }
+
+
+/* print a hunk header like "4,5c4" */
+static void print_hunk_header( const int a1, const int a2, const char c,
+                               const int b1, const int b2 )
+  {
+  char buf[64];
+  int len = ( a1 < a2 ) ? snprintf( buf, 32, "%d,%d", a1, a2 ) :
+                          snprintf( buf, 32, "%d", a1 );
+  buf[len++] = c;
+  if( b1 < b2 ) snprintf( buf + len, 32, "%d,%d", b1, b2 );
+  else snprintf( buf + len, 32, "%d", b1 );
+  print_message( buf );
+  }
+
+
+/* print lines of spans from 'from' to 'to' (0-based) with prefix */
+static bool print_spans( const span_t * const spans, int from, const int to,
+                         const char * const prefix )
+  {
+  static char * buf = 0;
+  static int bufsz = 0;
+  for( ; from < to; ++from )
+    {
+    line_t l;
+    const char * s;
+    if( interrupted() ) return false;
+    l.pos = spans[from].pos; l.len = spans[from].len;
+    s = get_sbuf_line( &l );
+    if( !s || !resize_buffer( &buf, &bufsz, l.len + 3 ) ) return false;
+    memcpy( buf, prefix, 2 ); memcpy( buf + 2, s, l.len + 1 );
+    print_message( buf );
+    }
+  return true;
+  }
+
+
+/* Print the changes from snapshot c to the buffer as diff(1) does. */
+bool diff_snapshot( const int c )
+  {
+  static span_t * cur = 0;		/* the buffer */
+  static int cur_size = 0;
+  const snapshot_t * const sp = get_snapshot( c, true );
+  const span_t * a, * b;
+  char * del, * ins;
+  int n, m, p = 0, i = 0, j = 0;
+  bool ok = true;
+
+  if( !sp || !copy_spans( 1, last_addr(), &cur, &cur_size ) ) return false;
+  a = sp->spans; n = sp->lines; b = cur; m = last_addr();
+  while( p < n && p < m && same_line( a + p, b + p ) ) ++p;	/* prefix */
+  while( n > p && m > p && same_line( a + n - 1, b + m - 1 ) ) { --n; --m; }
+  del = (char *)malloc( max( n - p, 1 ) );
+  ins = (char *)malloc( max( m - p, 1 ) );
+  if( !del || !ins )
+    { free( del ); free( ins ); set_error_msg( mem_msg ); return false; }
+  diff_spans( a + p, n - p, b + p, m - p, del, ins );
+  while( ok && ( i < n - p || j < m - p ) )
+    {
+    int i2 = i, j2 = j;
+    if( i < n - p && j < m - p && !del[i] && !ins[j] ) { ++i; ++j; continue; }
+    while( i2 < n - p && del[i2] ) ++i2;
+    while( j2 < m - p && ins[j2] ) ++j2;
+    /* hunk: a[p+i..p+i2) replaced by b[p+j..p+j2) */
+    if( i2 > i && j2 > j )
+      print_hunk_header( p + i + 1, p + i2, 'c', p + j + 1, p + j2 );
+    else if( i2 > i ) print_hunk_header( p + i + 1, p + i2, 'd', p + j, p + j );
+    else print_hunk_header( p + i, p + i, 'a', p + j + 1, p + j2 );
+    ok = print_spans( a + p, i, i2, "< " );
+    if( ok && i2 > i && j2 > j ) print_message( "---" );
+    if( ok ) ok = print_spans( b + p, j, j2, "> " );
+    i = i2; j = j2;
+    }
+  free( del ); free( ins );
+  return ok;
+  }
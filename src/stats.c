@@ -0,0 +1,189 @@
+/* stats.c: per-command cost accounting for the ed line editor. */
+/* GNU ed - The GNU line editor.
+   Copyright (C) 2022 Mathias Fuchs
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ed.h"
+
+
+typedef struct			/* accumulated cost of a command */
+  {
+  unsigned long count;		/* number of times executed */
+  long long wall;		/* elapsed time in nanoseconds */
+  long long cpu;		/* process cpu time in nanoseconds */
+  unsigned long long lines;	/* lines read from or written to scratch */
+  unsigned long long rbytes;	/* bytes read from scratch */
+  unsigned long long wbytes;	/* bytes written to scratch */
+  unsigned long long allocs;	/* calls to malloc/realloc */
+  }
+cmd_stats_t;
+
+counters_t counters;			/* updated by the core routines */
+mem_stats_t mem_stats;			/* updated by the allocators */
+static cmd_stats_t cmd_stats[256];	/* indexed by command character */
+static cmd_stats_t global_stats;	/* command lists of 'g', 'v', etc */
+
+
+static long long clock_ns( const clockid_t id )
+  {
+  struct timespec ts;
+  if( clock_gettime( id, &ts ) != 0 ) return 0;
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  }
+
+
+void mark_command_start( cmd_mark_t * const mp )
+  {
+  mp->wall = clock_ns( CLOCK_MONOTONIC );
+  mp->cpu = clock_ns( CLOCK_PROCESS_CPUTIME_ID );
+  mp->counters = counters;
+  }
+
+
+static void account( cmd_stats_t * const sp, const cmd_mark_t * const mp )
+  {
+  ++sp->count;
+  sp->wall += clock_ns( CLOCK_MONOTONIC ) - mp->wall;
+  sp->cpu += clock_ns( CLOCK_PROCESS_CPUTIME_ID ) - mp->cpu;
+  sp->lines += counters.sbuf_reads - mp->counters.sbuf_reads +
+               counters.sbuf_writes - mp->counters.sbuf_writes;
+  sp->rbytes += counters.sbuf_read_bytes - mp->counters.sbuf_read_bytes;
+  sp->wbytes += counters.sbuf_write_bytes - mp->counters.sbuf_write_bytes;
+  sp->allocs += counters.allocs - mp->counters.allocs;
+  }
+
+
+/* charge the cost since mark to command 'c' */
+void account_command( const cmd_mark_t * const mp, const int c )
+  { if( c > 0 && c < 256 ) account( &cmd_stats[c], mp ); }
+
+/* charge the cost since mark to the command list of a global command */
+void account_global( const cmd_mark_t * const mp )
+  { account( &global_stats, mp ); }
+
+
+static void print_row( const char * const name, const cmd_stats_t * const sp,
+                       const bool at_exit )
+  {
+  char buf[160];
+  snprintf( buf, sizeof buf, "%-6s %8lu %11.3f %11.3f %10llu %12llu %12llu %9llu",
+            name, sp->count, sp->wall / 1e6, sp->cpu / 1e6, sp->lines,
+            sp->rbytes, sp->wbytes, sp->allocs );
+  if( at_exit ) fprintf( stderr, "%s\n", buf ); else print_message( buf );
+  }
+
+
+/* Print the table of accumulated command costs, to stderr if at_exit.
+   Times include those of the commands run by a global command. */
+void print_command_stats( const bool at_exit )
+  {
+  const char * const header =
+    "cmd       count     wall_ms      cpu_ms      lines      rd_bytes"
+    "     wr_bytes    allocs";
+  int c;
+
+  if( at_exit ) fprintf( stderr, "%s\n", header ); else print_message( header );
+  for( c = 1; c < 256; ++c )
+    if( cmd_stats[c].count )
+      {
+      char name[3] = { (char)c, 0, 0 };
+      if( c == '\n' ) { name[0] = '\\'; name[1] = 'n'; }
+      print_row( name, &cmd_stats[c], at_exit );
+      }
+  if( global_stats.count ) print_row( "(list)", &global_stats, at_exit );
+  }
+
+
+/* Print the hot-path counters of the core routines, to stderr if at_exit. */
+void print_counters( const bool at_exit )
+  {
+  const struct { const char * name; unsigned long long value; } table[] =
+    {
+    { "sbuf_reads",       counters.sbuf_reads },
+    { "sbuf_read_bytes",  counters.sbuf_read_bytes },
+    { "sbuf_writes",      counters.sbuf_writes },
+    { "sbuf_write_bytes", counters.sbuf_write_bytes },
+    { "sbuf_seeks",       counters.sbuf_seeks },
+    { "allocs",           counters.allocs },
+    { "searches",         counters.searches },
+    { "search_steps",     counters.search_steps },
+    { "addr_walks",       counters.addr_walks },
+    { "addr_steps",       counters.addr_steps },
+    { "regexecs",         counters.regexecs },
+    { "regex_misses",     counters.regex_misses },
+    { "highlights",       counters.highlights },
+    { "highlight_in",     counters.highlight_in },
+    { "highlight_out",    counters.highlight_out },
+    { "highlight_hits",   counters.highlight_hits },
+    { "idle_steps",       counters.idle_steps } };
+  unsigned i;
+
+  for( i = 0; i < sizeof table / sizeof table[0]; ++i )
+    {
+    char buf[64];
+    snprintf( buf, sizeof buf, "%-16s %20llu", table[i].name, table[i].value );
+    if( at_exit ) fprintf( stderr, "%s\n", buf ); else print_message( buf );
+    }
+  }
+
+
+static void print_memory_row( const char * const name, const long bytes,
+                              const long count )
+  {
+  char buf[80];
+  if( count >= 0 )
+    snprintf( buf, sizeof buf, "%-16s %16ld %12ld", name, bytes, count );
+  else snprintf( buf, sizeof buf, "%-16s %16ld", name, bytes );
+  print_message( buf );
+  }
+
+
+/* Print the memory in use by category, and how much of the scratch file
+   is referenced by the lines in the buffer. Lines copied with 't' or 'x'
+   share their text, so the unreferenced part is a lower bound. */
+void print_memory_stats( void )
+  {
+  const long node_size = sizeof (line_t);
+  const long undo_nodes = mem_stats.nodes - last_addr() - mem_stats.yank_nodes;
+  const long dead = mem_stats.scratch_size - mem_stats.scratch_live;
+
+  print_message( "category                    bytes        lines" );
+  print_memory_row( "buffer nodes", last_addr() * node_size, last_addr() );
+  print_memory_row( "undo nodes", undo_nodes * node_size, undo_nodes );
+  print_memory_row( "undo stack", mem_stats.undo_stack, -1 );
+  if( mem_stats.undo_tree )
+    print_memory_row( "undo tree", mem_stats.undo_tree, -1 );
+  print_memory_row( "yank nodes", mem_stats.yank_nodes * node_size,
+                    mem_stats.yank_nodes );
+  print_memory_row( "active list", mem_stats.active_list, -1 );
+  print_memory_row( "line buffers", mem_stats.line_buffers, -1 );
+  print_memory_row( "highlight", mem_stats.highlight, -1 );
+  print_memory_row( "lexer", mem_stats.lexer, -1 );
+  print_memory_row( "scratch file", mem_stats.scratch_size, -1 );
+  print_memory_row( "  referenced", mem_stats.scratch_live, -1 );
+  print_memory_row( "  unreferenced", ( dead > 0 ) ? dead : 0, -1 );
+  }
+
+
+static void print_stats_at_exit( void ) { print_command_stats( true ); }
+static void print_counters_at_exit( void ) { print_counters( true ); }
+
+void set_stats_at_exit( void ) { atexit( print_stats_at_exit ); }
+void set_counters_at_exit( void ) { atexit( print_counters_at_exit ); }